@@ -0,0 +1,134 @@
+#include "document_loader.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open "s + path);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0) {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat "s + path);
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ > 0) {
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data_ == MAP_FAILED) {
+                const int error = errno;
+                close(fd);
+                throw std::system_error(error, std::generic_category(), "mmap "s + path);
+            }
+            madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (size_ > 0) {
+            munmap(data_, size_);
+        }
+    }
+
+    std::string_view View() const {
+        return size_ > 0 ? std::string_view(static_cast<const char*>(data_), size_) : std::string_view();
+    }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+std::string_view NextField(std::string_view& line) {
+    const size_t tab = line.find('\t');
+    const std::string_view field = line.substr(0, tab);
+    line.remove_prefix(tab == line.npos ? line.size() : tab + 1);
+    return field;
+}
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [ptr, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || ptr != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid number "s + std::string(text));
+    }
+    return value;
+}
+
+}  // namespace
+
+std::string_view DocumentStatusName(DocumentStatus status) {
+    switch (status) {
+    case DocumentStatus::ACTUAL:
+        return "ACTUAL"sv;
+    case DocumentStatus::IRRELEVANT:
+        return "IRRELEVANT"sv;
+    case DocumentStatus::BANNED:
+        return "BANNED"sv;
+    case DocumentStatus::REMOVED:
+        return "REMOVED"sv;
+    }
+    return {};
+}
+
+DocumentStatus ParseDocumentStatus(std::string_view name) {
+    for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                                        DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+        if (DocumentStatusName(status) == name) {
+            return status;
+        }
+    }
+    throw std::invalid_argument("Unknown document status "s + std::string(name));
+}
+
+int LoadDocuments(SearchServer& search_server, const std::string& path) {
+    const MappedFile file(path);
+    std::string_view text = file.View();
+
+    int loaded = 0;
+    int line_number = 0;
+    std::vector<int> ratings;
+    while (!text.empty()) {
+        const size_t line_end = text.find('\n');
+        std::string_view line = text.substr(0, line_end);
+        text.remove_prefix(line_end == text.npos ? text.size() : line_end + 1);
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        try {
+            const int document_id = ParseInt(NextField(line));
+            const DocumentStatus status = ParseDocumentStatus(NextField(line));
+            ratings.clear();
+            for (const std::string_view rating : SplitIntoWords(NextField(line))) {
+                ratings.push_back(ParseInt(rating));
+            }
+            search_server.AddDocument(document_id, line, status, ratings);
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(path + ":"s + std::to_string(line_number) + ": "s + e.what());
+        }
+        ++loaded;
+    }
+    return loaded;
+}
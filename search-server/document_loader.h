@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "search_server.h"
+
+// Documents file format, one document per line:
+//     <id>\t<status>\t<ratings separated by spaces>\t<text>
+// status is one of ACTUAL, IRRELEVANT, BANNED, REMOVED.
+
+std::string_view DocumentStatusName(DocumentStatus status);
+
+DocumentStatus ParseDocumentStatus(std::string_view name);
+
+// Maps the file into memory and adds every document to search_server.
+// Returns the number of loaded documents.
+int LoadDocuments(SearchServer& search_server, const std::string& path);
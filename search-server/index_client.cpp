@@ -0,0 +1,167 @@
+#include "index_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "index_protocol.h"
+
+using namespace std::string_literals;
+
+IndexClient::IndexClient(const std::string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long"s);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+    if (connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        const int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), "connect "s + socket_path);
+    }
+}
+
+IndexClient::~IndexClient() {
+    close(fd_);
+}
+
+std::vector<Document> IndexClient::FindTopDocuments(std::string_view raw_query, DocumentStatus status) {
+    const uint32_t request_id = next_request_id_++;
+    std::string request;
+    AppendFindRequest(request, request_id, raw_query, status);
+    Send(request);
+    return ReadDocuments(Receive(request_id));
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus> IndexClient::MatchDocument(std::string_view raw_query, int document_id) {
+    const uint32_t request_id = next_request_id_++;
+    std::string request;
+    FrameWriter writer(request);
+    writer.WriteU32(request_id).WriteU8(static_cast<uint8_t>(RequestType::MATCH_DOCUMENT));
+    writer.WriteI32(document_id).WriteString(raw_query);
+    writer.Finish();
+    Send(request);
+
+    FrameReader reader(Receive(request_id));
+    const auto status = static_cast<DocumentStatus>(reader.ReadU8());
+    std::vector<std::string> words(reader.ReadU32());
+    for (std::string& word : words) {
+        word = std::string(reader.ReadString());
+    }
+    return {words, status};
+}
+
+std::vector<std::vector<Document>> IndexClient::ProcessQueries(const std::vector<std::string>& queries, DocumentStatus status) {
+    const uint32_t first_request_id = next_request_id_;
+    std::string requests;
+    for (const std::string& query : queries) {
+        AppendFindRequest(requests, next_request_id_++, query, status);
+    }
+    Send(requests);
+
+    // Every response has to be drained even if one of the queries failed,
+    // otherwise the next call would read a stale answer
+    std::vector<std::vector<Document>> result(queries.size());
+    std::exception_ptr first_error;
+    for (size_t i = 0; i < result.size(); ++i) {
+        try {
+            result[i] = ReadDocuments(Receive(first_request_id + static_cast<uint32_t>(i)));
+        } catch (const std::logic_error&) {
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+    return result;
+}
+
+void IndexClient::AppendFindRequest(std::string& out, uint32_t request_id, std::string_view raw_query, DocumentStatus status) {
+    FrameWriter writer(out);
+    writer.WriteU32(request_id).WriteU8(static_cast<uint8_t>(RequestType::FIND_TOP_DOCUMENTS));
+    writer.WriteU8(static_cast<uint8_t>(status)).WriteString(raw_query);
+    writer.Finish();
+}
+
+void IndexClient::Send(std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t sent = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "send");
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+
+std::string_view IndexClient::Receive(uint32_t request_id) {
+    input_.erase(0, input_offset_);
+    input_offset_ = 0;
+
+    size_t frame_size = 0;
+    auto payload = ExtractFrame(input_, frame_size);
+    while (!payload) {
+        char buffer[64 * 1024];
+        const ssize_t received = recv(fd_, buffer, sizeof(buffer), 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "recv");
+        }
+        if (received == 0) {
+            throw std::runtime_error("Connection closed by server"s);
+        }
+        input_.append(buffer, static_cast<size_t>(received));
+        payload = ExtractFrame(input_, frame_size);
+    }
+    input_offset_ = frame_size;
+
+    FrameReader reader(*payload);
+    if (reader.ReadU32() != request_id) {
+        throw std::runtime_error("Unexpected response id"s);
+    }
+    reader.ReadU8();
+    const auto code = static_cast<ResponseCode>(reader.ReadU8());
+    const size_t header_size = sizeof(uint32_t) + 2 * sizeof(uint8_t);
+    if (code == ResponseCode::OK) {
+        return payload->substr(header_size);
+    }
+
+    const std::string message(reader.ReadString());
+    switch (code) {
+    case ResponseCode::INVALID_ARGUMENT:
+        throw std::invalid_argument(message);
+    case ResponseCode::OUT_OF_RANGE:
+        throw std::out_of_range(message);
+    default:
+        throw std::runtime_error(message);
+    }
+}
+
+std::vector<Document> IndexClient::ReadDocuments(std::string_view payload) {
+    FrameReader reader(payload);
+    std::vector<Document> documents(reader.ReadU32());
+    for (Document& document : documents) {
+        document.id = reader.ReadI32();
+        document.relevance = reader.ReadDouble();
+        document.rating = reader.ReadI32();
+    }
+    return documents;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+
+// Client side of search_server_daemon. Mirrors the query part of the
+// SearchServer interface; server-side std::invalid_argument and
+// std::out_of_range are rethrown with the same types.
+// An IndexClient is a single connection and must not be shared between threads.
+class IndexClient {
+public:
+    explicit IndexClient(const std::string& socket_path);
+
+    IndexClient(const IndexClient&) = delete;
+    IndexClient& operator=(const IndexClient&) = delete;
+
+    ~IndexClient();
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id);
+
+    // Sends all queries before reading any response, so the whole batch costs one round trip
+    std::vector<std::vector<Document>> ProcessQueries(const std::vector<std::string>& queries,
+                                                      DocumentStatus status = DocumentStatus::ACTUAL);
+
+private:
+    int fd_ = -1;
+    uint32_t next_request_id_ = 0;
+    std::string input_;
+    size_t input_offset_ = 0;
+
+    void AppendFindRequest(std::string& out, uint32_t request_id, std::string_view raw_query, DocumentStatus status);
+
+    void Send(std::string_view data);
+
+    // Returns the payload of the next response after checking its id and code.
+    // The view stays valid until the next call.
+    std::string_view Receive(uint32_t request_id);
+
+    static std::vector<Document> ReadDocuments(std::string_view payload);
+};
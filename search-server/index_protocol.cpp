@@ -0,0 +1,104 @@
+#include "index_protocol.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+FrameWriter::FrameWriter(std::string& out)
+    : out_(out)
+    , frame_start_(out.size()) {
+    WriteU32(0);
+}
+
+FrameWriter& FrameWriter::WriteU8(uint8_t value) {
+    return WriteRaw(value);
+}
+
+FrameWriter& FrameWriter::WriteU32(uint32_t value) {
+    return WriteRaw(value);
+}
+
+FrameWriter& FrameWriter::WriteI32(int32_t value) {
+    return WriteRaw(value);
+}
+
+FrameWriter& FrameWriter::WriteDouble(double value) {
+    return WriteRaw(value);
+}
+
+FrameWriter& FrameWriter::WriteString(std::string_view value) {
+    WriteU32(static_cast<uint32_t>(value.size()));
+    out_.append(value.data(), value.size());
+    return *this;
+}
+
+void FrameWriter::Finish() {
+    const uint32_t payload_size = static_cast<uint32_t>(out_.size() - frame_start_ - sizeof(uint32_t));
+    std::memcpy(out_.data() + frame_start_, &payload_size, sizeof(payload_size));
+}
+
+template <typename T>
+FrameWriter& FrameWriter::WriteRaw(T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out_.append(bytes, sizeof(T));
+    return *this;
+}
+
+FrameReader::FrameReader(std::string_view payload)
+    : payload_(payload) {
+}
+
+uint8_t FrameReader::ReadU8() {
+    return ReadRaw<uint8_t>();
+}
+
+uint32_t FrameReader::ReadU32() {
+    return ReadRaw<uint32_t>();
+}
+
+int32_t FrameReader::ReadI32() {
+    return ReadRaw<int32_t>();
+}
+
+double FrameReader::ReadDouble() {
+    return ReadRaw<double>();
+}
+
+std::string_view FrameReader::ReadString() {
+    const uint32_t size = ReadU32();
+    if (payload_.size() < size) {
+        throw std::invalid_argument("Truncated frame"s);
+    }
+    const std::string_view result = payload_.substr(0, size);
+    payload_.remove_prefix(size);
+    return result;
+}
+
+template <typename T>
+T FrameReader::ReadRaw() {
+    if (payload_.size() < sizeof(T)) {
+        throw std::invalid_argument("Truncated frame"s);
+    }
+    T value;
+    std::memcpy(&value, payload_.data(), sizeof(T));
+    payload_.remove_prefix(sizeof(T));
+    return value;
+}
+
+std::optional<std::string_view> ExtractFrame(std::string_view buffer, size_t& frame_size) {
+    uint32_t payload_size;
+    if (buffer.size() < sizeof(payload_size)) {
+        return std::nullopt;
+    }
+    std::memcpy(&payload_size, buffer.data(), sizeof(payload_size));
+    if (payload_size > MAX_FRAME_SIZE) {
+        throw std::invalid_argument("Frame is too large"s);
+    }
+    if (buffer.size() - sizeof(payload_size) < payload_size) {
+        return std::nullopt;
+    }
+    frame_size = sizeof(payload_size) + payload_size;
+    return buffer.substr(sizeof(payload_size), payload_size);
+}
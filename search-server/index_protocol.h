@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Binary protocol of search_server_daemon. Every message is a frame: a uint32
+// payload size followed by the payload. Numbers are written in native byte
+// order because both ends always live on the same host (Unix domain socket).
+//
+// Request payload:  uint32 request_id, uint8 RequestType, then
+//     FIND_TOP_DOCUMENTS: uint8 status, string raw_query
+//     MATCH_DOCUMENT:     int32 document_id, string raw_query
+// Response payload: uint32 request_id, uint8 RequestType, uint8 ResponseCode, then
+//     error:              string message
+//     FIND_TOP_DOCUMENTS: uint32 count, count * (int32 id, double relevance, int32 rating)
+//     MATCH_DOCUMENT:     uint8 status, uint32 count, count * string word
+// Strings are a uint32 size followed by the bytes.
+//
+// A client may send any number of requests without waiting for responses;
+// the server answers every connection in request order.
+
+const uint32_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+enum class RequestType : uint8_t {
+    FIND_TOP_DOCUMENTS = 1,
+    MATCH_DOCUMENT = 2,
+};
+
+enum class ResponseCode : uint8_t {
+    OK = 0,
+    INVALID_ARGUMENT = 1,
+    OUT_OF_RANGE = 2,
+    INTERNAL_ERROR = 3,
+};
+
+class FrameWriter {
+public:
+    explicit FrameWriter(std::string& out);
+
+    FrameWriter& WriteU8(uint8_t value);
+
+    FrameWriter& WriteU32(uint32_t value);
+
+    FrameWriter& WriteI32(int32_t value);
+
+    FrameWriter& WriteDouble(double value);
+
+    FrameWriter& WriteString(std::string_view value);
+
+    // Patches the payload size of the frame started by the constructor
+    void Finish();
+
+private:
+    std::string& out_;
+    size_t frame_start_;
+
+    template <typename T>
+    FrameWriter& WriteRaw(T value);
+};
+
+class FrameReader {
+public:
+    explicit FrameReader(std::string_view payload);
+
+    uint8_t ReadU8();
+
+    uint32_t ReadU32();
+
+    int32_t ReadI32();
+
+    double ReadDouble();
+
+    std::string_view ReadString();
+
+private:
+    std::string_view payload_;
+
+    template <typename T>
+    T ReadRaw();
+};
+
+// Returns the payload of the first complete frame in buffer and sets
+// frame_size to the number of bytes it occupies, or nullopt if more data is needed.
+// Throws std::invalid_argument if the frame is larger than MAX_FRAME_SIZE.
+std::optional<std::string_view> ExtractFrame(std::string_view buffer, size_t& frame_size);
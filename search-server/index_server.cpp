@@ -0,0 +1,276 @@
+#include "index_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <execution>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+void ThrowSystemError(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void SetNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ThrowSystemError("fcntl");
+    }
+}
+
+}  // namespace
+
+IndexServer::IndexServer(const SearchServer& search_server, const std::string& socket_path)
+    : search_server_(search_server)
+    , socket_path_(socket_path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long"s);
+    }
+    std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+    if (pipe(wakeup_pipe_) < 0) {
+        ThrowSystemError("pipe");
+    }
+    SetNonBlocking(wakeup_pipe_[0]);
+    SetNonBlocking(wakeup_pipe_[1]);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        ThrowSystemError("socket");
+    }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        ThrowSystemError("bind");
+    }
+    if (listen(listen_fd_, SOMAXCONN) < 0) {
+        ThrowSystemError("listen");
+    }
+    SetNonBlocking(listen_fd_);
+}
+
+IndexServer::~IndexServer() {
+    for (const Connection& connection : connections_) {
+        close(connection.fd);
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+    for (const int fd : wakeup_pipe_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void IndexServer::Run() {
+    std::vector<pollfd> poll_fds;
+    std::vector<Connection*> polled_connections;
+
+    while (true) {
+        poll_fds.clear();
+        polled_connections.clear();
+        poll_fds.push_back({wakeup_pipe_[0], POLLIN, 0});
+        poll_fds.push_back({listen_fd_, POLLIN, 0});
+        for (Connection& connection : connections_) {
+            const short events = (connection.read_closed ? 0 : POLLIN) | (connection.output.empty() ? 0 : POLLOUT);
+            poll_fds.push_back({connection.fd, events, 0});
+            polled_connections.push_back(&connection);
+        }
+
+        if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("poll");
+        }
+        if (poll_fds[0].revents != 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < polled_connections.size(); ++i) {
+            if (poll_fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ReadFrom(*polled_connections[i]);
+            }
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            AcceptConnections();
+        }
+
+        ExecuteBatch();
+
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if (!it->output.empty() && !it->failed) {
+                WriteTo(*it);
+            }
+            if (it->failed || (it->read_closed && it->output.empty())) {
+                close(it->fd);
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void IndexServer::Stop() {
+    const char byte = 0;
+    [[maybe_unused]] const ssize_t written = write(wakeup_pipe_[1], &byte, 1);
+}
+
+void IndexServer::AcceptConnections() {
+    while (true) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ThrowSystemError("accept");
+            }
+            return;
+        }
+        SetNonBlocking(fd);
+        connections_.push_back({fd, {}, {}});
+    }
+}
+
+void IndexServer::ReadFrom(Connection& connection) {
+    char buffer[64 * 1024];
+    while (true) {
+        const ssize_t received = read(connection.fd, buffer, sizeof(buffer));
+        if (received > 0) {
+            connection.input.append(buffer, static_cast<size_t>(received));
+            continue;
+        }
+        if (received == 0) {
+            connection.read_closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.failed = true;
+        }
+        return;
+    }
+}
+
+void IndexServer::WriteTo(Connection& connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        const ssize_t sent = send(connection.fd, connection.output.data() + written,
+                                  connection.output.size() - written, MSG_NOSIGNAL);
+        if (sent > 0) {
+            written += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.failed = true;
+        }
+        break;
+    }
+    connection.output.erase(0, written);
+}
+
+void IndexServer::ExecuteBatch() {
+    std::vector<PendingRequest> batch;
+    std::vector<std::pair<Connection*, size_t>> consumed;
+
+    for (Connection& connection : connections_) {
+        size_t offset = 0;
+        try {
+            size_t frame_size = 0;
+            while (const auto payload = ExtractFrame(std::string_view(connection.input).substr(offset), frame_size)) {
+                batch.push_back({&connection, *payload, {}});
+                offset += frame_size;
+            }
+        } catch (const std::invalid_argument&) {
+            connection.failed = true;
+        }
+        if (offset > 0) {
+            consumed.emplace_back(&connection, offset);
+        }
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    std::for_each(std::execution::par, batch.begin(), batch.end(), [this](PendingRequest& request) {
+        ExecuteRequest(request);
+    });
+
+    for (PendingRequest& request : batch) {
+        request.connection->output += request.response;
+    }
+    for (const auto& [connection, size] : consumed) {
+        connection->input.erase(0, size);
+    }
+}
+
+void IndexServer::ExecuteRequest(PendingRequest& request) const {
+    FrameReader reader(request.payload);
+    uint32_t request_id = 0;
+    uint8_t type = 0;
+
+    const auto write_error = [&request, &request_id, &type](ResponseCode code, std::string_view message) {
+        request.response.clear();
+        FrameWriter writer(request.response);
+        writer.WriteU32(request_id).WriteU8(type).WriteU8(static_cast<uint8_t>(code)).WriteString(message);
+        writer.Finish();
+    };
+
+    try {
+        request_id = reader.ReadU32();
+        type = reader.ReadU8();
+        FrameWriter writer(request.response);
+        writer.WriteU32(request_id).WriteU8(type);
+
+        switch (static_cast<RequestType>(type)) {
+        case RequestType::FIND_TOP_DOCUMENTS: {
+            const auto status = static_cast<DocumentStatus>(reader.ReadU8());
+            const std::string_view raw_query = reader.ReadString();
+            const std::vector<Document> documents = search_server_.FindTopDocuments(raw_query, status);
+
+            writer.WriteU8(static_cast<uint8_t>(ResponseCode::OK)).WriteU32(static_cast<uint32_t>(documents.size()));
+            for (const Document& document : documents) {
+                writer.WriteI32(document.id).WriteDouble(document.relevance).WriteI32(document.rating);
+            }
+            break;
+        }
+        case RequestType::MATCH_DOCUMENT: {
+            const int document_id = reader.ReadI32();
+            const std::string_view raw_query = reader.ReadString();
+            const auto [words, status] = search_server_.MatchDocument(raw_query, document_id);
+
+            writer.WriteU8(static_cast<uint8_t>(ResponseCode::OK)).WriteU8(static_cast<uint8_t>(status));
+            writer.WriteU32(static_cast<uint32_t>(words.size()));
+            for (const std::string_view word : words) {
+                writer.WriteString(word);
+            }
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unknown request type "s + std::to_string(type));
+        }
+        writer.Finish();
+    } catch (const std::invalid_argument& e) {
+        write_error(ResponseCode::INVALID_ARGUMENT, e.what());
+    } catch (const std::out_of_range& e) {
+        write_error(ResponseCode::OUT_OF_RANGE, e.what());
+    } catch (const std::exception& e) {
+        write_error(ResponseCode::INTERNAL_ERROR, e.what());
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <string_view>
+
+#include "index_protocol.h"
+#include "search_server.h"
+
+// Serves one SearchServer to many local processes over a Unix domain socket,
+// see index_protocol.h for the wire format. Requests that arrive together,
+// from one or several connections, are executed as a parallel batch.
+class IndexServer {
+public:
+    IndexServer(const SearchServer& search_server, const std::string& socket_path);
+
+    IndexServer(const IndexServer&) = delete;
+    IndexServer& operator=(const IndexServer&) = delete;
+
+    ~IndexServer();
+
+    // Blocks serving connections until Stop() is called
+    void Run();
+
+    // Async-signal-safe, may be called from a signal handler or another thread
+    void Stop();
+
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        bool read_closed = false;
+        bool failed = false;
+    };
+
+    struct PendingRequest {
+        Connection* connection;
+        std::string_view payload;
+        std::string response;
+    };
+
+    const SearchServer& search_server_;
+    const std::string socket_path_;
+    int listen_fd_ = -1;
+    int wakeup_pipe_[2] = {-1, -1};
+    std::list<Connection> connections_;
+
+    void AcceptConnections();
+
+    void ReadFrom(Connection& connection);
+
+    void WriteTo(Connection& connection);
+
+    // Answers every complete frame received so far
+    void ExecuteBatch();
+
+    void ExecuteRequest(PendingRequest& request) const;
+};
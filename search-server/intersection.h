@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+// Sorted-sequence intersection for posting and position lists of very
+// different lengths: every element of the shorter list is looked up in the
+// longer one by galloping, doubling the step from the previous match and then
+// binary searching the last step, so the cost is O(m log(n / m)).
+
+// First element of [first, last) not less than value
+template <typename T>
+const T* GallopLowerBound(const T* first, const T* last, const T& value) {
+    size_t step = 1;
+    const T* low = first;
+    while (low + step < last && low[step] < value) {
+        low += step;
+        step *= 2;
+    }
+    return std::lower_bound(low, std::min(low + step + 1, last), value);
+}
+
+// Calls output(element) for every element present in both sorted ranges
+template <typename T, typename Output>
+void IntersectSorted(const T* lhs, const T* lhs_last, const T* rhs, const T* rhs_last, Output output) {
+    if (lhs_last - lhs > rhs_last - rhs) {
+        std::swap(lhs, rhs);
+        std::swap(lhs_last, rhs_last);
+    }
+    for (; lhs != lhs_last && rhs != rhs_last; ++lhs) {
+        rhs = GallopLowerBound(rhs, rhs_last, *lhs);
+        if (rhs != rhs_last && *rhs == *lhs) {
+            output(*lhs);
+            ++rhs;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int SUB_BUCKET_BITS = 6;
+const uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+// Values below this are counted exactly
+const uint64_t EXACT_LIMIT = 2 * SUB_BUCKET_COUNT;
+const size_t BUCKET_COUNT = EXACT_LIMIT + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKET_COUNT;
+
+int HighestBit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+size_t GetBucketIndex(uint64_t value) {
+    if (value < EXACT_LIMIT) {
+        return static_cast<size_t>(value);
+    }
+    // value >> shift is in [SUB_BUCKET_COUNT, 2 * SUB_BUCKET_COUNT)
+    const int shift = HighestBit(value) - SUB_BUCKET_BITS;
+    const uint64_t sub_bucket = (value >> shift) - SUB_BUCKET_COUNT;
+    return static_cast<size_t>(EXACT_LIMIT + (shift - 1) * SUB_BUCKET_COUNT + sub_bucket);
+}
+
+// The largest value counted in the bucket
+uint64_t GetBucketHighestValue(size_t index) {
+    if (index < EXACT_LIMIT) {
+        return index;
+    }
+    const int shift = static_cast<int>((index - EXACT_LIMIT) / SUB_BUCKET_COUNT) + 1;
+    const uint64_t mantissa = (index - EXACT_LIMIT) % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(BUCKET_COUNT, 0) {
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds latency) {
+    const uint64_t value = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+    ++counts_[GetBucketIndex(value)];
+    ++total_count_;
+    max_ = std::max(max_, value);
+    sum_ += value;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    total_count_ += other.total_count_;
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return total_count_;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetPercentile(double percent) const {
+    if (total_count_ == 0) {
+        return {};
+    }
+    const double clamped = std::clamp(percent, 0.0, 100.0);
+    const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(clamped / 100.0 * total_count_)), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::chrono::nanoseconds(std::min(GetBucketHighestValue(i), max_));
+        }
+    }
+    return GetMax();
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMax() const {
+    return std::chrono::nanoseconds(max_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMean() const {
+    if (total_count_ == 0) {
+        return {};
+    }
+    return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(sum_ / total_count_));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Latency distribution with bounded relative error, in the manner of
+// HdrHistogram: values up to 127 ns are counted exactly, larger ones in 64
+// linear sub-buckets per power of two, so any percentile is reported within
+// 1/64 of the recorded value. Recording is O(1) and never allocates.
+// Not thread-safe: record per thread and Merge the results.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void Record(std::chrono::nanoseconds latency);
+
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const;
+
+    // The smallest recorded latency not exceeded by percent% of the records,
+    // rounded up to the end of its sub-bucket
+    std::chrono::nanoseconds GetPercentile(double percent) const;
+
+    std::chrono::nanoseconds GetMax() const;
+
+    std::chrono::nanoseconds GetMean() const;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_count_ = 0;
+    uint64_t max_ = 0;
+    // Sum of the recorded nanoseconds, as long double to stay exact enough for hours of records
+    long double sum_ = 0;
+};
@@ -0,0 +1,212 @@
+#include "log_duration.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+using namespace std::string_literals;
+
+namespace {
+
+struct ScopeStats {
+    uint64_t count = 0;
+    std::chrono::nanoseconds total{};
+    std::chrono::nanoseconds min = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds max{};
+    LatencyHistogram histogram;
+
+    void Record(std::chrono::nanoseconds duration) {
+        ++count;
+        total += duration;
+        min = std::min(min, duration);
+        max = std::max(max, duration);
+        histogram.Record(duration);
+    }
+
+    void Merge(const ScopeStats& other) {
+        count += other.count;
+        total += other.total;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        histogram.Merge(other.histogram);
+    }
+};
+
+// The mutex is taken by its thread on every record and by reports, so it is
+// practically never contended
+struct ThreadProfile {
+    std::mutex mutex;
+    // Indexed by scope id, null for the scopes the thread has not run
+    std::vector<std::unique_ptr<ScopeStats>> scopes;
+
+    void Merge(const ThreadProfile& other) {
+        if (scopes.size() < other.scopes.size()) {
+            scopes.resize(other.scopes.size());
+        }
+        for (size_t scope = 0; scope < other.scopes.size(); ++scope) {
+            if (!other.scopes[scope]) {
+                continue;
+            }
+            if (!scopes[scope]) {
+                scopes[scope] = std::make_unique<ScopeStats>();
+            }
+            scopes[scope]->Merge(*other.scopes[scope]);
+        }
+    }
+};
+
+class ProfileRegistry {
+public:
+    size_t RegisterScope(std::string_view name) {
+        std::lock_guard lock(mutex_);
+        const auto found = ids_.find(name);
+        if (found != ids_.end()) {
+            return found->second;
+        }
+        names_.emplace_back(name);
+        ids_.emplace(names_.back(), names_.size() - 1);
+        return names_.size() - 1;
+    }
+
+    void AddThread(ThreadProfile* profile) {
+        std::lock_guard lock(mutex_);
+        threads_.push_back(profile);
+    }
+
+    // Keeps the statistics of a finishing thread
+    void RetireThread(ThreadProfile* profile) {
+        std::lock_guard lock(mutex_);
+        {
+            std::lock_guard profile_lock(profile->mutex);
+            retired_.Merge(*profile);
+        }
+        threads_.erase(std::find(threads_.begin(), threads_.end(), profile));
+    }
+
+    std::vector<ProfileStats> GetStats() {
+        ThreadProfile total;
+        std::vector<std::string> names;
+        {
+            std::lock_guard lock(mutex_);
+            total.Merge(retired_);
+            for (ThreadProfile* profile : threads_) {
+                std::lock_guard profile_lock(profile->mutex);
+                total.Merge(*profile);
+            }
+            names = names_;
+        }
+
+        std::vector<ProfileStats> stats;
+        for (size_t scope = 0; scope < total.scopes.size(); ++scope) {
+            if (!total.scopes[scope]) {
+                continue;
+            }
+            ScopeStats& scope_stats = *total.scopes[scope];
+            stats.push_back({names[scope], scope_stats.count, scope_stats.total, scope_stats.min, scope_stats.max,
+                             std::move(scope_stats.histogram)});
+        }
+        std::sort(stats.begin(), stats.end(), [](const ProfileStats& lhs, const ProfileStats& rhs) {
+            return lhs.total > rhs.total;
+        });
+        return stats;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, size_t, std::less<>> ids_;
+    std::vector<std::string> names_;
+    std::vector<ThreadProfile*> threads_;
+    ThreadProfile retired_;
+};
+
+// Never destroyed: threads may finish and the exit report run during static destruction
+ProfileRegistry& GetRegistry() {
+    static ProfileRegistry* registry = new ProfileRegistry;
+    return *registry;
+}
+
+class ThreadProfileHolder {
+public:
+    ThreadProfileHolder() {
+        GetRegistry().AddThread(&profile_);
+    }
+
+    ~ThreadProfileHolder() {
+        GetRegistry().RetireThread(&profile_);
+    }
+
+    ThreadProfile& Get() {
+        return profile_;
+    }
+
+private:
+    ThreadProfile profile_;
+};
+
+ThreadProfile& GetThreadProfile() {
+    thread_local ThreadProfileHolder holder;
+    return holder.Get();
+}
+
+std::ostream* report_at_exit_stream = nullptr;
+
+void PrintProfileReportAtExitHandler() {
+    PrintProfileReport(*report_at_exit_stream);
+}
+
+}  // namespace
+
+size_t RegisterProfileScope(std::string_view name) {
+    return GetRegistry().RegisterScope(name);
+}
+
+void RecordProfileScope(size_t scope, std::chrono::nanoseconds duration) {
+    ThreadProfile& profile = GetThreadProfile();
+    std::lock_guard lock(profile.mutex);
+    if (scope >= profile.scopes.size()) {
+        profile.scopes.resize(scope + 1);
+    }
+    if (!profile.scopes[scope]) {
+        profile.scopes[scope] = std::make_unique<ScopeStats>();
+    }
+    profile.scopes[scope]->Record(duration);
+}
+
+std::vector<ProfileStats> GetProfileStats() {
+    return GetRegistry().GetStats();
+}
+
+void PrintProfileReport(std::ostream& out) {
+    const auto microseconds = [](std::chrono::nanoseconds duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::left << std::setw(32) << "Scope"s << std::right << std::setw(12) << "Count"s
+        << std::setw(14) << "Total ms"s << std::setw(12) << "Mean us"s << std::setw(12) << "Min us"s
+        << std::setw(12) << "p50 us"s << std::setw(12) << "p99 us"s << std::setw(12) << "Max us"s << '\n';
+    out << std::fixed << std::setprecision(3);
+    for (const ProfileStats& stats : GetProfileStats()) {
+        out << std::left << std::setw(32) << stats.name << std::right << std::setw(12) << stats.count
+            << std::setw(14) << std::chrono::duration<double, std::milli>(stats.total).count()
+            << std::setw(12) << microseconds(stats.total) / stats.count
+            << std::setw(12) << microseconds(stats.min)
+            << std::setw(12) << microseconds(stats.histogram.GetPercentile(50))
+            << std::setw(12) << microseconds(stats.histogram.GetPercentile(99))
+            << std::setw(12) << microseconds(stats.max) << '\n';
+    }
+    out.flush();
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void PrintProfileReportAtExit(std::ostream& out) {
+    static std::once_flag registered;
+    report_at_exit_stream = &out;
+    std::call_once(registered, [] {
+        std::atexit(PrintProfileReportAtExitHandler);
+    });
+}
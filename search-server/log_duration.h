@@ -1,8 +1,13 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <string>
 #include <string_view>
+#include <vector>
+
+#include "latency_histogram.h"
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
 #define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
@@ -10,6 +15,60 @@
 #define LOG_DURATION(x) LogDuration UNIQUE_VAR_NAME_PROFILE(x)
 #define LOG_DURATION_STREAM(x, y) LogDuration UNIQUE_VAR_NAME_PROFILE(x, y)
 
+// Adds the lifetime of the enclosing scope to the profile of the name without
+// printing anything, so it can be left in code that runs millions of times.
+// The name is looked up once per call site.
+#define PROFILE_SCOPE(x)                                                                    \
+    static const size_t PROFILE_CONCAT(profileScope, __LINE__) = RegisterProfileScope(x);   \
+    ProfileScope UNIQUE_VAR_NAME_PROFILE(PROFILE_CONCAT(profileScope, __LINE__))
+
+// Aggregated durations of a named scope over all threads
+struct ProfileStats {
+    std::string name;
+    uint64_t count = 0;
+    std::chrono::nanoseconds total{};
+    std::chrono::nanoseconds min{};
+    std::chrono::nanoseconds max{};
+    LatencyHistogram histogram;
+};
+
+// Id of the named scope, the same for every call with the name
+size_t RegisterProfileScope(std::string_view name);
+
+// Records into the statistics of the current thread: an uncontended lock and
+// no allocation once the thread has seen the scope
+void RecordProfileScope(size_t scope, std::chrono::nanoseconds duration);
+
+// Statistics of all threads, alive or finished, the largest total first
+std::vector<ProfileStats> GetProfileStats();
+
+void PrintProfileReport(std::ostream& out);
+
+// Prints the report when the program exits, once however many times it is called
+void PrintProfileReportAtExit(std::ostream& out = std::cerr);
+
+class ProfileScope {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ProfileScope(size_t scope)
+        : scope_(scope) {
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        RecordProfileScope(scope_, Clock::now() - start_time_);
+    }
+
+private:
+    const size_t scope_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+// Prints the duration in milliseconds when destroyed and adds it to the
+// profile of the id
 class LogDuration {
 public:
     using Clock = std::chrono::steady_clock;
@@ -26,10 +85,11 @@ public:
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
         dst_stream_ << id_ << ": "sv << duration_cast<milliseconds>(dur).count() << " ms"sv << std::endl;
+        RecordProfileScope(RegisterProfileScope(id_), dur);
     }
 
 private:
     const std::string id_;
     const Clock::time_point start_time_ = Clock::now();
     std::ostream& dst_stream_;
-};
\ No newline at end of file
+};
@@ -0,0 +1,102 @@
+#include "posting_list.h"
+
+#include <algorithm>
+
+PostingList::PostingList(const allocator_type& allocator)
+    : document_ids_(allocator)
+    , term_freqs_(allocator)
+    , document_lengths_(allocator) {
+}
+
+PostingList::PostingList(const PostingList& other, const allocator_type& allocator)
+    : document_ids_(other.document_ids_, allocator)
+    , term_freqs_(other.term_freqs_, allocator)
+    , document_lengths_(other.document_lengths_, allocator) {
+}
+
+PostingList::PostingList(PostingList&& other, const allocator_type& allocator)
+    : document_ids_(std::move(other.document_ids_), allocator)
+    , term_freqs_(std::move(other.term_freqs_), allocator)
+    , document_lengths_(std::move(other.document_lengths_), allocator) {
+}
+
+size_t PostingList::size() const {
+    return document_ids_.size();
+}
+
+bool PostingList::empty() const {
+    return document_ids_.empty();
+}
+
+bool PostingList::Contains(int document_id) const {
+    return std::binary_search(document_ids_.begin(), document_ids_.end(), document_id);
+}
+
+void PostingList::Insert(int document_id, double term_freq, int document_length) {
+    if (document_ids_.empty() || document_ids_.back() < document_id) {
+        document_ids_.push_back(document_id);
+        term_freqs_.push_back(term_freq);
+        document_lengths_.push_back(document_length);
+        return;
+    }
+    const size_t index = LowerBound(document_id);
+    document_ids_.insert(document_ids_.begin() + index, document_id);
+    term_freqs_.insert(term_freqs_.begin() + index, term_freq);
+    document_lengths_.insert(document_lengths_.begin() + index, document_length);
+}
+
+void PostingList::Erase(int document_id) {
+    const size_t index = LowerBound(document_id);
+    if (index == document_ids_.size() || document_ids_[index] != document_id) {
+        return;
+    }
+    document_ids_.erase(document_ids_.begin() + index);
+    term_freqs_.erase(term_freqs_.begin() + index);
+    document_lengths_.erase(document_lengths_.begin() + index);
+}
+
+void PostingList::Erase(const int* first, const int* last) {
+    // One merge pass over both sorted sequences
+    size_t kept = 0;
+    for (size_t index = 0; index < document_ids_.size(); ++index) {
+        while (first != last && *first < document_ids_[index]) {
+            ++first;
+        }
+        if (first != last && *first == document_ids_[index]) {
+            continue;
+        }
+        document_ids_[kept] = document_ids_[index];
+        term_freqs_[kept] = term_freqs_[index];
+        document_lengths_[kept] = document_lengths_[index];
+        ++kept;
+    }
+    document_ids_.resize(kept);
+    term_freqs_.resize(kept);
+    document_lengths_.resize(kept);
+}
+
+void PostingList::Clear() {
+    document_ids_.clear();
+    term_freqs_.clear();
+    document_lengths_.clear();
+}
+
+size_t PostingList::LowerBound(int document_id) const {
+    return std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id) - document_ids_.begin();
+}
+
+size_t PostingList::UpperBound(int document_id) const {
+    return std::upper_bound(document_ids_.begin(), document_ids_.end(), document_id) - document_ids_.begin();
+}
+
+const int* PostingList::DocumentIds() const {
+    return document_ids_.data();
+}
+
+const double* PostingList::TermFreqs() const {
+    return term_freqs_.data();
+}
+
+const int* PostingList::DocumentLengths() const {
+    return document_lengths_.data();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Documents containing a word, sorted by id and stored as parallel arrays, so
+// the scoring kernel reads the postings a block at a time. Appending a document
+// with a greater id than all stored ones is amortized O(1), other insertions and
+// erasures shift the tail of the arrays.
+class PostingList {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    explicit PostingList(const allocator_type& allocator);
+
+    PostingList(const PostingList& other, const allocator_type& allocator);
+
+    PostingList(PostingList&& other, const allocator_type& allocator);
+
+    size_t size() const;
+
+    bool empty() const;
+
+    bool Contains(int document_id) const;
+
+    void Insert(int document_id, double term_freq, int document_length);
+
+    void Erase(int document_id);
+
+    // Erases the stored documents with ids in [first, last), which must be sorted
+    void Erase(const int* first, const int* last);
+
+    void Clear();
+
+    // Index of the first posting with an id not less than document_id
+    size_t LowerBound(int document_id) const;
+
+    // Index of the first posting with an id greater than document_id
+    size_t UpperBound(int document_id) const;
+
+    const int* DocumentIds() const;
+
+    const double* TermFreqs() const;
+
+    const int* DocumentLengths() const;
+
+private:
+    std::pmr::vector<int> document_ids_;
+    std::pmr::vector<double> term_freqs_;
+    std::pmr::vector<int> document_lengths_;
+};
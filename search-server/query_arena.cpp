@@ -0,0 +1,77 @@
+#include "query_arena.h"
+
+#include <algorithm>
+
+QueryArena::Scope::Scope()
+    : arena_(QueryArena::ForCurrentThread())
+{
+    arena_.Enter();
+}
+
+QueryArena::Scope::~Scope() {
+    arena_.Leave();
+}
+
+std::pmr::memory_resource* QueryArena::Scope::Resource() const {
+    return &*arena_.resource_;
+}
+
+QueryArena& QueryArena::ForCurrentThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+void QueryArena::Enter() {
+    if (depth_++ > 0) {
+        return;
+    }
+    if (!buffer_) {
+        buffer_size_ = INITIAL_SIZE;
+        buffer_ = std::make_unique<std::byte[]>(buffer_size_);
+    }
+    resource_.emplace(buffer_.get(), buffer_size_, &upstream_);
+}
+
+void QueryArena::Leave() {
+    if (--depth_ > 0) {
+        return;
+    }
+    resource_.reset();
+    if (upstream_.overflow_bytes > 0 && buffer_size_ < MAX_SIZE) {
+        buffer_size_ = std::min(MAX_SIZE, 2 * (buffer_size_ + upstream_.overflow_bytes));
+        buffer_ = std::make_unique<std::byte[]>(buffer_size_);
+    }
+    upstream_.overflow_bytes = 0;
+}
+
+void* QueryArena::OverflowCounter::do_allocate(size_t bytes, size_t alignment) {
+    overflow_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::OverflowCounter::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool QueryArena::OverflowCounter::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+SynchronizedResource::SynchronizedResource(std::pmr::memory_resource* upstream)
+    : upstream_(upstream)
+{
+}
+
+void* SynchronizedResource::do_allocate(size_t bytes, size_t alignment) {
+    std::lock_guard guard(mutex_);
+    return upstream_->allocate(bytes, alignment);
+}
+
+void SynchronizedResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    std::lock_guard guard(mutex_);
+    upstream_->deallocate(p, bytes, alignment);
+}
+
+bool SynchronizedResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
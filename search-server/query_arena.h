@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+
+// Per-thread scratch memory of a query. Everything a query allocates while it
+// runs comes from a monotonic buffer that is released at once when the
+// outermost QueryArena::Scope of the thread ends. After a query overflows the
+// buffer it is regrown to the new high-water mark, so in steady state queries
+// do not call the global allocator at all.
+class QueryArena {
+public:
+    class Scope {
+    public:
+        Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope();
+
+        std::pmr::memory_resource* Resource() const;
+
+    private:
+        QueryArena& arena_;
+    };
+
+    static constexpr size_t INITIAL_SIZE = 16 * 1024;
+    static constexpr size_t MAX_SIZE = 64 * 1024 * 1024;
+
+private:
+    // Remembers how much the monotonic buffer had to request beyond the arena
+    class OverflowCounter : public std::pmr::memory_resource {
+    public:
+        size_t overflow_bytes = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_t buffer_size_ = 0;
+    OverflowCounter upstream_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    int depth_ = 0;
+
+    static QueryArena& ForCurrentThread();
+
+    void Enter();
+
+    void Leave();
+};
+
+// Makes a resource usable from the worker threads of a parallel algorithm
+class SynchronizedResource : public std::pmr::memory_resource {
+public:
+    explicit SynchronizedResource(std::pmr::memory_resource* upstream);
+
+private:
+    std::pmr::memory_resource* upstream_;
+    std::mutex mutex_;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
@@ -0,0 +1,45 @@
+#include "query_trace.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std::string_literals;
+
+namespace {
+
+std::string FormatTime(std::chrono::nanoseconds time) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::micro>(time).count() << " us"s;
+    return out.str();
+}
+
+}  // namespace
+
+std::string QueryTrace::ToString() const {
+    std::ostringstream out;
+    out << "Parse: "s << FormatTime(parse_time) << ", stem cache "s << stem_cache_hits << " hits, "s
+        << stem_cache_misses << " misses\n"s;
+    if (candidate_count) {
+        out << "Candidates: "s << *candidate_count << " documents in "s << FormatTime(candidate_time) << '\n';
+    }
+    out << std::left << std::setw(24) << "Term"s << std::right << std::setw(12) << "Documents"s
+        << std::setw(12) << "Visited"s << std::setw(10) << "Weight"s << std::setw(14) << "Time"s << '\n';
+    for (const Term& term : terms) {
+        out << std::left << std::setw(24) << ((term.is_minus ? "-"s : ""s) + term.word) << std::right
+            << std::setw(12) << term.document_frequency << std::setw(12) << term.postings_visited << std::setw(10);
+        if (term.is_minus || term.document_frequency == 0) {
+            out << ""s;
+        } else {
+            out << std::fixed << std::setprecision(3) << term.weight;
+        }
+        out << std::setw(14) << FormatTime(term.scan_time) << '\n';
+    }
+    out << "Scan: "s << FormatTime(scan_time) << ", minus words "s << FormatTime(minus_time)
+        << ", collection "s << FormatTime(collect_time) << " over "s << shard_count
+        << (shard_count == 1 ? " shard\n"s : " shards\n"s);
+    out << "Accumulators: "s << accumulator_slots << " slots, "s << dense_accumulators << " of "s << shard_count << " dense\n"s;
+    out << "Documents: "s << documents_scored << " scored, "s << documents_matched << " matched, "s
+        << documents_returned << " returned, sorted in "s << FormatTime(sort_time) << '\n';
+    out << "Total: "s << FormatTime(total_time) << '\n';
+    return out.str();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// How a query was executed, filled in by FindTopDocuments when
+// QueryOptions::trace is set. Times of the scoring stages are summed over the
+// shards of a parallel query, so they are CPU time rather than wall time.
+struct QueryTrace {
+    struct Term {
+        // Dictionary word, or the expansions of a merged pattern joined by |
+        std::string word;
+        // Minus words only exclude documents and have no weight
+        bool is_minus = false;
+        double weight = 0.0;
+        // Zero for a word that is not in the index
+        size_t document_frequency = 0;
+        // Postings read, or candidates looked up when the query has required
+        // words or positional constraints
+        size_t postings_visited = 0;
+        std::chrono::nanoseconds scan_time{};
+    };
+
+    std::chrono::nanoseconds parse_time{};
+    std::chrono::nanoseconds candidate_time{};
+    std::chrono::nanoseconds scan_time{};
+    std::chrono::nanoseconds minus_time{};
+    // Reading the accumulators and checking the predicate
+    std::chrono::nanoseconds collect_time{};
+    std::chrono::nanoseconds sort_time{};
+    std::chrono::nanoseconds total_time{};
+
+    std::vector<Term> terms;
+    size_t stem_cache_hits = 0;
+    size_t stem_cache_misses = 0;
+    // Documents satisfying the required words and positional constraints, if any
+    std::optional<size_t> candidate_count;
+    size_t shard_count = 0;
+    // Score slots of the accumulators: the id range of a dense one, the touched
+    // documents of a sparse one
+    size_t accumulator_slots = 0;
+    size_t dense_accumulators = 0;
+    // Documents with a score that no minus word excluded
+    size_t documents_scored = 0;
+    // Scored documents accepted by the predicate
+    size_t documents_matched = 0;
+    size_t documents_returned = 0;
+
+    // Human-readable report, one line per stage and term
+    std::string ToString() const;
+};
+
+// Times the stages of a traced query. Without a trace it never reads the clock.
+class TraceTimer {
+public:
+    explicit TraceTimer(const QueryTrace* trace)
+        : lap_start_(trace ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}) {
+    }
+
+    // Time since the previous lap or construction
+    std::chrono::nanoseconds Lap() {
+        const auto now = std::chrono::steady_clock::now();
+        const auto lap = now - lap_start_;
+        lap_start_ = now;
+        return lap;
+    }
+
+private:
+    std::chrono::steady_clock::time_point lap_start_;
+};
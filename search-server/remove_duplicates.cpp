@@ -1,31 +1,129 @@
+#include <algorithm>
+#include <execution>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
 
 #include "remove_duplicates.h"
+#include "word_hash.h"
 
-void RemoveDuplicates(SearchServer& search_server) {
+namespace {
 
-std::map<std::set<std::string_view>, int> documents;
-std::vector<int> remove_id;
+bool HaveSameWords(const SearchServer& search_server, int lhs_id, int rhs_id) {
+    const auto& lhs = search_server.GetWordFrequencies(lhs_id);
+    const auto& rhs = search_server.GetWordFrequencies(rhs_id);
+    return lhs.size() == rhs.size()
+        && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](const auto& lhs_word, const auto& rhs_word) {
+               return lhs_word.first == rhs_word.first;
+           });
+}
 
-for (auto document_id : search_server) {
-    std::set<std::string_view> words;
+double EstimateSimilarity(const uint64_t* lhs, const uint64_t* rhs, size_t signature_size) {
+    size_t equal = 0;
+    for (size_t i = 0; i < signature_size; ++i) {
+        equal += lhs[i] == rhs[i];
+    }
+    return static_cast<double>(equal) / signature_size;
+}
 
-    for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
-        words.insert(word);
+void RemoveAndReport(SearchServer& search_server, const std::vector<int>& duplicates) {
+    search_server.RemoveDocuments(std::execution::par, duplicates);
+    for (const int id : duplicates) {
+        std::cout << "Found duplicate document id "s << id << std::endl;
     }
+}
+
+}  // namespace
 
-    if (documents.find(words) == documents.end()) {
-        documents[words] = document_id;
-    } else {
-        remove_id.push_back(document_id);
+std::vector<int> FindDuplicates(const SearchServer& search_server) {
+    std::unordered_map<uint64_t, std::vector<int>> kept_by_fingerprint;
+    std::vector<int> duplicates;
+
+    for (const int document_id : search_server) {
+        auto& kept = kept_by_fingerprint[search_server.GetWordSetFingerprint(document_id)];
+        // Equal fingerprints of different word sets are possible, just very unlikely
+        const bool is_duplicate = std::any_of(kept.begin(), kept.end(), [&search_server, document_id](int kept_id) {
+            return HaveSameWords(search_server, kept_id, document_id);
+        });
+        if (is_duplicate) {
+            duplicates.push_back(document_id);
+        } else {
+            kept.push_back(document_id);
+        }
     }
+    return duplicates;
 }
 
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    if (options.band_count <= 0 || options.rows_per_band <= 0) {
+        throw std::invalid_argument("LSH band layout must be positive"s);
+    }
+    const size_t band_count = options.band_count;
+    const size_t rows_per_band = options.rows_per_band;
+    const size_t signature_size = band_count * rows_per_band;
+
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<size_t> indexes(document_ids.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    // MinHash: element k of a signature is the minimum of the k-th hash function
+    // over the document words; two signatures agree in a fraction of elements
+    // equal on average to the Jaccard similarity of the word sets
+    std::vector<uint64_t> signatures(document_ids.size() * signature_size);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+        [&search_server, &document_ids, &signatures, signature_size](size_t index) {
+            uint64_t* const signature = signatures.data() + index * signature_size;
+            std::fill(signature, signature + signature_size, UINT64_MAX);
+            for (const auto& [word, freq] : search_server.GetWordFrequencies(document_ids[index])) {
+                const uint64_t word_hash = HashWord(word);
+                for (size_t k = 0; k < signature_size; ++k) {
+                    signature[k] = std::min(signature[k], MixHash(word_hash + (k + 1) * 0x9e3779b97f4a7c15ULL));
+                }
+            }
+        });
+
+    // Only kept documents are put into the band buckets, so every duplicate is
+    // reported against a document that stays in the server
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> bands(band_count);
+    std::vector<uint64_t> band_keys(band_count);
+    std::vector<int> duplicates;
+
+    for (const size_t index : indexes) {
+        const uint64_t* const signature = signatures.data() + index * signature_size;
+        bool is_duplicate = false;
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = band;
+            for (size_t row = 0; row < rows_per_band; ++row) {
+                key = MixHash(key ^ signature[band * rows_per_band + row]);
+            }
+            band_keys[band] = key;
 
-for (int id : remove_id) {
-    search_server.RemoveDocument(id);
-    std::cout << "Found duplicate document id "s << id << std::endl;
+            const auto bucket = bands[band].find(key);
+            if (is_duplicate || bucket == bands[band].end()) {
+                continue;
+            }
+            is_duplicate = std::any_of(bucket->second.begin(), bucket->second.end(), [&](size_t kept_index) {
+                const uint64_t* const kept_signature = signatures.data() + kept_index * signature_size;
+                return EstimateSimilarity(signature, kept_signature, signature_size) >= options.similarity_threshold;
+            });
+        }
+
+        if (is_duplicate) {
+            duplicates.push_back(document_ids[index]);
+            continue;
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            bands[band][band_keys[band]].push_back(index);
+        }
+    }
+    return duplicates;
 }
 
+void RemoveDuplicates(SearchServer& search_server) {
+    RemoveAndReport(search_server, FindDuplicates(search_server));
 }
 
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    RemoveAndReport(search_server, FindNearDuplicates(search_server, options));
+}
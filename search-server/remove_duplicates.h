@@ -1,5 +1,26 @@
 #pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
+struct NearDuplicateOptions {
+    // Minimal Jaccard similarity of word sets, estimated by MinHash
+    double similarity_threshold = 0.8;
+    // LSH layout: documents sharing all rows of at least one band become candidates.
+    // More rows per band make candidates stricter, more bands catch lower similarities.
+    int band_count = 16;
+    int rows_per_band = 4;
+};
+
+// Ids of documents whose word set equals the one of a document with a smaller id.
+// Groups documents by word-set fingerprint, so it runs in linear time.
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+// Ids of documents similar to a kept document with a smaller id.
+// Signatures are computed in parallel.
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options = {});
+
 void RemoveDuplicates(SearchServer& search_server);
+
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = {});
@@ -1,29 +1,226 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_{search_server}
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+
+std::string GetRejectMessage(RejectReason reason) {
+    switch (reason) {
+        case RejectReason::COST:
+            return "Request rejected: query cost over budget"s;
+        case RejectReason::QUEUE_FULL:
+            return "Request rejected: queue full"s;
+        case RejectReason::DEADLINE:
+            return "Request rejected: deadline passed"s;
+    }
+    return "Request rejected"s;
+}
+
+}  // namespace
+
+RequestRejectedError::RequestRejectedError(RejectReason reason)
+    : std::runtime_error(GetRejectMessage(reason))
+    , reason_(reason) {
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options)
+    : search_server_{search_server}
+    , options_(options)
 {
+    if (options.bucket_width <= std::chrono::nanoseconds::zero() || options.bucket_count == 0) {
+        throw std::invalid_argument("Request window must have buckets of positive width"s);
+    }
+    buckets_ = std::make_unique<Bucket[]>(options.bucket_count);
+    head_epoch_.store(GetEpoch(Clock::now()), std::memory_order_relaxed);
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    std::vector<Document> answer = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(answer);
-    return answer;
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status,
+                                                   const RequestOptions& request_options) {
+    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, request_options);
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    return RequestQueue::AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, const RequestOptions& request_options) {
+    return RequestQueue::AddFindRequest(raw_query, DocumentStatus::ACTUAL, request_options);
+}
+
+void RequestQueue::RecordRequest(bool has_results, Clock::time_point time) {
+    const int64_t epoch = GetEpoch(time);
+    Advance(epoch);
+    if (epoch <= head_epoch_.load(std::memory_order_acquire) - static_cast<int64_t>(options_.bucket_count)) {
+        // Already out of the window
+        return;
+    }
+    Bucket& bucket = buckets_[static_cast<uint64_t>(epoch) % options_.bucket_count];
+    bucket.requests.fetch_add(1, std::memory_order_relaxed);
+    window_requests_.fetch_add(1, std::memory_order_relaxed);
+    if (!has_results) {
+        bucket.no_result_requests.fetch_add(1, std::memory_order_relaxed);
+        window_no_result_requests_.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 int RequestQueue::GetNoResultRequests() const {
- return count_if(requests_.begin(), requests_.end(),
-             [](const QueryResult& i)    {return !i.result;});
+    Advance(GetEpoch(Clock::now()));
+    return static_cast<int>(std::max<int64_t>(window_no_result_requests_.load(std::memory_order_relaxed), 0));
+}
+
+uint64_t RequestQueue::GetRequestCount() const {
+    Advance(GetEpoch(Clock::now()));
+    return static_cast<uint64_t>(std::max<int64_t>(window_requests_.load(std::memory_order_relaxed), 0));
+}
+
+double RequestQueue::GetNoResultRate() const {
+    Advance(GetEpoch(Clock::now()));
+    const int64_t requests = window_requests_.load(std::memory_order_relaxed);
+    const int64_t no_result_requests = window_no_result_requests_.load(std::memory_order_relaxed);
+    if (requests <= 0) {
+        return 0.0;
+    }
+    return std::clamp(static_cast<double>(no_result_requests) / requests, 0.0, 1.0);
+}
+
+uint64_t RequestQueue::GetRejectedRequests(RejectReason reason) const {
+    return rejected_requests_[static_cast<size_t>(reason)].load(std::memory_order_relaxed);
+}
+
+uint64_t RequestQueue::GetDegradedRequests() const {
+    return degraded_requests_.load(std::memory_order_relaxed);
+}
+
+size_t RequestQueue::GetWaitingRequests() const {
+    std::lock_guard lock(admission_mutex_);
+    return waiting_requests_;
+}
+
+int64_t RequestQueue::GetEpoch(Clock::time_point time) const {
+    return time.time_since_epoch() / options_.bucket_width;
+}
+
+void RequestQueue::Advance(int64_t epoch) const {
+    if (head_epoch_.load(std::memory_order_acquire) >= epoch) {
+        return;
+    }
+    std::lock_guard lock(advance_mutex_);
+    const int64_t head_epoch = head_epoch_.load(std::memory_order_relaxed);
+    if (head_epoch >= epoch) {
+        return;
+    }
+    // The buckets of the epochs entering the window still hold the counts of
+    // the epochs bucket_count earlier, which leave it
+    const int64_t bucket_count = static_cast<int64_t>(options_.bucket_count);
+    for (int64_t entering = std::max(head_epoch + 1, epoch - bucket_count + 1); entering <= epoch; ++entering) {
+        Bucket& bucket = buckets_[static_cast<uint64_t>(entering) % options_.bucket_count];
+        window_requests_.fetch_sub(bucket.requests.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        window_no_result_requests_.fetch_sub(bucket.no_result_requests.exchange(0, std::memory_order_relaxed),
+                                             std::memory_order_relaxed);
+    }
+    head_epoch_.store(epoch, std::memory_order_release);
 }
 
 void RequestQueue::AddRequest(const std::vector<Document>& answer) {
-    ++count_;
-    if (requests_.size() >= min_in_day_) {
-           requests_.pop_front();
-           --count_;
+    RecordRequest(!answer.empty());
+}
+
+RequestQueue::Admission::Admission(RequestQueue& request_queue, const RequestOptions& request_options)
+    : request_queue_(request_queue) {
+    const RequestQueueOptions& options = request_queue.options_;
+    // The cost is checked by the search after it parses the query, under the
+    // slot, so expanding the patterns of an expensive query is limited too
+    query_options_.max_query_postings = options.max_query_postings;
+    if (options.max_concurrent_requests == 0) {
+        return;
+    }
+    const bool degraded = request_queue.AcquireSlot(request_options);
+    holds_slot_ = true;
+    if (degraded) {
+        query_options_.max_postings_per_term = options.degraded_postings_per_term;
+        request_queue.degraded_requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+RequestQueue::Admission::~Admission() {
+    if (holds_slot_) {
+        request_queue_.ReleaseSlot();
+    }
+}
+
+bool RequestQueue::AcquireSlot(const RequestOptions& request_options) {
+    std::unique_lock lock(admission_mutex_);
+    const auto is_deep = [this] {
+        return options_.degrade_queue_depth != 0 && waiting_requests_ >= options_.degrade_queue_depth;
+    };
+    if (request_options.deadline && *request_options.deadline <= Clock::now()) {
+        Reject(RejectReason::DEADLINE);
+    }
+    if (running_requests_ < options_.max_concurrent_requests && waiting_requests_ == 0) {
+        ++running_requests_;
+        return false;
+    }
+
+    const size_t priority = static_cast<size_t>(request_options.priority);
+    if (options_.max_queued_requests != 0 && waiting_requests_ >= options_.max_queued_requests) {
+        // The newest waiter of the lowest priority below ours makes room
+        size_t displaced_priority = waiters_.size() - 1;
+        while (displaced_priority > priority && waiters_[displaced_priority].empty()) {
+            --displaced_priority;
+        }
+        if (displaced_priority == priority) {
+            Reject(RejectReason::QUEUE_FULL);
+        }
+        Waiter* const displaced = waiters_[displaced_priority].back();
+        waiters_[displaced_priority].pop_back();
+        --waiting_requests_;
+        displaced->state = WaiterState::DISPLACED;
+        displaced->wakeup.notify_one();
+    }
+
+    Waiter waiter;
+    auto& queue = waiters_[priority];
+    queue.push_back(&waiter);
+    ++waiting_requests_;
+    const auto is_woken = [&waiter] {
+        return waiter.state != WaiterState::WAITING;
+    };
+    if (request_options.deadline) {
+        if (!waiter.wakeup.wait_until(lock, *request_options.deadline, is_woken)) {
+            queue.erase(std::find(queue.begin(), queue.end(), &waiter));
+            --waiting_requests_;
+            Reject(RejectReason::DEADLINE);
+        }
+    } else {
+        waiter.wakeup.wait(lock, is_woken);
     }
-        requests_.push_back({count_, !answer.empty()});
+    if (waiter.state == WaiterState::DISPLACED) {
+        Reject(RejectReason::QUEUE_FULL);
+    }
+    return is_deep();
+}
+
+void RequestQueue::ReleaseSlot() {
+    std::lock_guard lock(admission_mutex_);
+    --running_requests_;
+    for (auto& queue : waiters_) {
+        if (queue.empty()) {
+            continue;
+        }
+        // Notified under the lock: once woken the waiter may return and
+        // destroy its condition variable
+        Waiter* const waiter = queue.front();
+        queue.pop_front();
+        --waiting_requests_;
+        ++running_requests_;
+        waiter->state = WaiterState::ADMITTED;
+        waiter->wakeup.notify_one();
+        return;
+    }
+}
+
+void RequestQueue::Reject(RejectReason reason) {
+    rejected_requests_[static_cast<size_t>(reason)].fetch_add(1, std::memory_order_relaxed);
+    throw RequestRejectedError(reason);
 }
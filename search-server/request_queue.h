@@ -1,36 +1,188 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include "search_server.h"
 
+struct RequestQueueOptions {
+    // Requests are counted per bucket of this width; the window is
+    // bucket_width * bucket_count, a day by default
+    std::chrono::nanoseconds bucket_width = std::chrono::minutes(1);
+    size_t bucket_count = 1440;
+
+    // Admission control, each limit off while 0.
+    // Requests searching at once; the others wait by priority
+    size_t max_concurrent_requests = 0;
+    // Waiting requests; when full a request displaces a waiting one of lower
+    // priority or is rejected
+    size_t max_queued_requests = 0;
+    // Requests whose posting lists are longer in total are rejected once
+    // admitted and parsed, before they are scored
+    size_t max_query_postings = 0;
+    // With this many requests waiting, the admitted ones score at most
+    // degraded_postings_per_term postings of each word
+    size_t degrade_queue_depth = 0;
+    size_t degraded_postings_per_term = 10000;
+};
+
+enum class RequestPriority {
+    HIGH,
+    NORMAL,
+    LOW,
+};
+
+struct RequestOptions {
+    RequestPriority priority = RequestPriority::NORMAL;
+    // Rejected if not admitted by then
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+};
+
+enum class RejectReason {
+    COST,
+    QUEUE_FULL,
+    DEADLINE,
+};
+
+// Thrown by AddFindRequest when admission control refuses a request
+class RequestRejectedError : public std::runtime_error {
+public:
+    explicit RequestRejectedError(RejectReason reason);
+
+    RejectReason GetReason() const {
+        return reason_;
+    }
+private:
+    RejectReason reason_;
+};
+
+// Front door of a SearchServer: admits requests under the limits of its
+// options and counts the requests of the last day and those that found nothing.
+//
+// Any number of threads may add requests and read the statistics at once.
+// Without a concurrency limit a request costs a few atomic increments; only
+// the first request of a bucket takes a lock, to retire the bucket that left
+// the window. Statistics are read in constant time from running window totals.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options = {});
 
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate,
+                                         const RequestOptions& request_options = {});
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status,
+                                         const RequestOptions& request_options = {});
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, const RequestOptions& request_options = {});
+
+    // Counts a request made to the server directly
+    void RecordRequest(bool has_results, Clock::time_point time = Clock::now());
 
     int GetNoResultRequests() const;
+
+    uint64_t GetRequestCount() const;
+
+    // Share of the requests in the window that found nothing, 0 if there were none
+    double GetNoResultRate() const;
+
+    // Since construction
+    uint64_t GetRejectedRequests(RejectReason reason) const;
+
+    uint64_t GetDegradedRequests() const;
+
+    // Requests waiting for a search slot at the moment
+    size_t GetWaitingRequests() const;
 private:
-    struct QueryResult {
-        int64_t time;
-        bool result;
+    struct Bucket {
+        std::atomic<int64_t> requests{0};
+        std::atomic<int64_t> no_result_requests{0};
+    };
+
+    enum class WaiterState {
+        WAITING,
+        ADMITTED,
+        DISPLACED,
+    };
+
+    struct Waiter {
+        std::condition_variable wakeup;
+        WaiterState state = WaiterState::WAITING;
+    };
+
+    // Holds a search slot while the request runs
+    class Admission {
+    public:
+        Admission(RequestQueue& request_queue, const RequestOptions& request_options);
+
+        Admission(const Admission&) = delete;
+        Admission& operator=(const Admission&) = delete;
+
+        ~Admission();
+
+        const QueryOptions& GetQueryOptions() const {
+            return query_options_;
+        }
+    private:
+        RequestQueue& request_queue_;
+        bool holds_slot_ = false;
+        QueryOptions query_options_;
     };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
+
     const SearchServer& search_server_;
-    int count_ = 0;
+    const RequestQueueOptions options_;
+    std::unique_ptr<Bucket[]> buckets_;
+    // Latest bucket of the window; the totals cover it and the
+    // bucket_count - 1 ones before
+    mutable std::atomic<int64_t> head_epoch_;
+    mutable std::mutex advance_mutex_;
+    // Signed, as a request is added to its bucket before the totals and may
+    // be retired in between
+    mutable std::atomic<int64_t> window_requests_{0};
+    mutable std::atomic<int64_t> window_no_result_requests_{0};
+
+    mutable std::mutex admission_mutex_;
+    size_t running_requests_ = 0;
+    // Oldest first, indexed by priority
+    std::array<std::deque<Waiter*>, 3> waiters_;
+    size_t waiting_requests_ = 0;
+    std::array<std::atomic<uint64_t>, 3> rejected_requests_{};
+    std::atomic<uint64_t> degraded_requests_{0};
+
+    int64_t GetEpoch(Clock::time_point time) const;
+
+    // Moves the window to end at the epoch, retiring the buckets left behind
+    void Advance(int64_t epoch) const;
+
+    // Waits for a search slot; returns whether the search is to be degraded
+    bool AcquireSlot(const RequestOptions& request_options);
+
+    void ReleaseSlot();
+
+    [[noreturn]] void Reject(RejectReason reason);
 
     void AddRequest(const std::vector<Document>& answer);
 };
 
 template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-   std::vector<Document> answer = search_server_.FindTopDocuments(raw_query, document_predicate);
-   AddRequest(answer);
-   return answer;
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate,
+                                                   const RequestOptions& request_options) {
+    const Admission admission(*this, request_options);
+    std::vector<Document> answer;
+    try {
+        answer = search_server_.FindTopDocuments(std::execution::seq, raw_query, document_predicate, admission.GetQueryOptions());
+    } catch (const QueryCostExceededError&) {
+        Reject(RejectReason::COST);
+    }
+    AddRequest(answer);
+    return answer;
 }
@@ -0,0 +1,233 @@
+#include "scoring.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The vector kernels evaluate the scalar formulas operation by operation, so
+// every kernel returns bit-identical scores. That holds as long as the compiler
+// does not fuse multiplies and adds, which the build turns off for this file.
+
+SimdLevel DetectSimdLevel() {
+#ifdef SEARCH_SERVER_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+struct Bm25Params {
+    double k1;
+    double b;
+    double delta;
+    double average_document_length;
+    double term_weight;
+};
+
+void ComputeTfIdfScoresScalar(double term_weight, const double* term_freqs, double* scores, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        scores[i] = term_freqs[i] * term_weight;
+    }
+}
+
+void ComputeBm25ScoresScalar(const Bm25Params& params, const double* term_freqs, const int* document_lengths,
+                             double* scores, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const double document_length = document_lengths[i];
+        const double term_count = term_freqs[i] * document_length;
+        const double length_norm = params.k1 * (1.0 - params.b + params.b * document_length / params.average_document_length);
+        scores[i] = params.term_weight * term_count * (params.k1 + 1.0) / (term_count + length_norm) + params.term_weight * params.delta;
+    }
+}
+
+#ifdef SEARCH_SERVER_X86_KERNELS
+
+__attribute__((target("avx2")))
+void ComputeTfIdfScoresAvx2(double term_weight, const double* term_freqs, double* scores, size_t count) {
+    const __m256d weight = _mm256_set1_pd(term_weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(scores + i, _mm256_mul_pd(_mm256_loadu_pd(term_freqs + i), weight));
+    }
+    ComputeTfIdfScoresScalar(term_weight, term_freqs + i, scores + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void ComputeBm25ScoresAvx2(const Bm25Params& params, const double* term_freqs, const int* document_lengths,
+                           double* scores, size_t count) {
+    const __m256d k1 = _mm256_set1_pd(params.k1);
+    const __m256d one_minus_b = _mm256_set1_pd(1.0 - params.b);
+    const __m256d b = _mm256_set1_pd(params.b);
+    const __m256d average_length = _mm256_set1_pd(params.average_document_length);
+    const __m256d weight = _mm256_set1_pd(params.term_weight);
+    const __m256d k1_plus_one = _mm256_set1_pd(params.k1 + 1.0);
+    const __m256d weighted_delta = _mm256_set1_pd(params.term_weight * params.delta);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256d length = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(document_lengths + i)));
+        const __m256d term_count = _mm256_mul_pd(_mm256_loadu_pd(term_freqs + i), length);
+        const __m256d length_norm = _mm256_mul_pd(k1, _mm256_add_pd(one_minus_b, _mm256_div_pd(_mm256_mul_pd(b, length), average_length)));
+        const __m256d score = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(weight, term_count), k1_plus_one),
+                                            _mm256_add_pd(term_count, length_norm));
+        _mm256_storeu_pd(scores + i, _mm256_add_pd(score, weighted_delta));
+    }
+    ComputeBm25ScoresScalar(params, term_freqs + i, document_lengths + i, scores + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+void ComputeTfIdfScoresAvx512(double term_weight, const double* term_freqs, double* scores, size_t count) {
+    const __m512d weight = _mm512_set1_pd(term_weight);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm512_storeu_pd(scores + i, _mm512_mul_pd(_mm512_loadu_pd(term_freqs + i), weight));
+    }
+    ComputeTfIdfScoresScalar(term_weight, term_freqs + i, scores + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+void ComputeBm25ScoresAvx512(const Bm25Params& params, const double* term_freqs, const int* document_lengths,
+                             double* scores, size_t count) {
+    const __m512d k1 = _mm512_set1_pd(params.k1);
+    const __m512d one_minus_b = _mm512_set1_pd(1.0 - params.b);
+    const __m512d b = _mm512_set1_pd(params.b);
+    const __m512d average_length = _mm512_set1_pd(params.average_document_length);
+    const __m512d weight = _mm512_set1_pd(params.term_weight);
+    const __m512d k1_plus_one = _mm512_set1_pd(params.k1 + 1.0);
+    const __m512d weighted_delta = _mm512_set1_pd(params.term_weight * params.delta);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // The zero-masking form with a full mask is the same conversion; GCC
+        // warns about the undefined source register of _mm512_cvtepi32_pd
+        const __m512d length = _mm512_maskz_cvtepi32_pd(0xFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(document_lengths + i)));
+        const __m512d term_count = _mm512_mul_pd(_mm512_loadu_pd(term_freqs + i), length);
+        const __m512d length_norm = _mm512_mul_pd(k1, _mm512_add_pd(one_minus_b, _mm512_div_pd(_mm512_mul_pd(b, length), average_length)));
+        const __m512d score = _mm512_div_pd(_mm512_mul_pd(_mm512_mul_pd(weight, term_count), k1_plus_one),
+                                            _mm512_add_pd(term_count, length_norm));
+        _mm512_storeu_pd(scores + i, _mm512_add_pd(score, weighted_delta));
+    }
+    ComputeBm25ScoresScalar(params, term_freqs + i, document_lengths + i, scores + i, count - i);
+}
+
+#endif
+
+void ComputeTfIdfScores(SimdLevel level, double term_weight, const double* term_freqs, double* scores, size_t count) {
+    switch (level) {
+#ifdef SEARCH_SERVER_X86_KERNELS
+    case SimdLevel::AVX512:
+        return ComputeTfIdfScoresAvx512(term_weight, term_freqs, scores, count);
+    case SimdLevel::AVX2:
+        return ComputeTfIdfScoresAvx2(term_weight, term_freqs, scores, count);
+#endif
+    default:
+        return ComputeTfIdfScoresScalar(term_weight, term_freqs, scores, count);
+    }
+}
+
+void ComputeBm25Scores(SimdLevel level, const Bm25Params& params, const double* term_freqs, const int* document_lengths,
+                       double* scores, size_t count) {
+    switch (level) {
+#ifdef SEARCH_SERVER_X86_KERNELS
+    case SimdLevel::AVX512:
+        return ComputeBm25ScoresAvx512(params, term_freqs, document_lengths, scores, count);
+    case SimdLevel::AVX2:
+        return ComputeBm25ScoresAvx2(params, term_freqs, document_lengths, scores, count);
+#endif
+    default:
+        return ComputeBm25ScoresScalar(params, term_freqs, document_lengths, scores, count);
+    }
+}
+
+}  // namespace
+
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+void ComputeScores(const AnyScorer& scorer, SimdLevel level, const CorpusStats& corpus, double term_weight,
+                   const double* term_freqs, const int* document_lengths, double* scores, size_t count) {
+    if (const auto* bm25 = std::get_if<Bm25Scorer>(&scorer)) {
+        ComputeBm25Scores(level, {bm25->k1, bm25->b, 0.0, corpus.average_document_length, term_weight},
+                          term_freqs, document_lengths, scores, count);
+    } else if (const auto* bm25_plus = std::get_if<Bm25PlusScorer>(&scorer)) {
+        ComputeBm25Scores(level, {bm25_plus->k1, bm25_plus->b, bm25_plus->delta, corpus.average_document_length, term_weight},
+                          term_freqs, document_lengths, scores, count);
+    } else {
+        ComputeTfIdfScores(level, term_weight, term_freqs, scores, count);
+    }
+}
+
+void TfIdfScorer::ComputeScores(const CorpusStats&, double term_weight, const double* term_freqs, const int*,
+                                double* scores, size_t count) const {
+    ComputeTfIdfScores(GetSimdLevel(), term_weight, term_freqs, scores, count);
+}
+
+void Bm25Scorer::ComputeScores(const CorpusStats& corpus, double term_weight, const double* term_freqs, const int* document_lengths,
+                               double* scores, size_t count) const {
+    ComputeBm25Scores(GetSimdLevel(), {k1, b, 0.0, corpus.average_document_length, term_weight}, term_freqs, document_lengths, scores, count);
+}
+
+void Bm25PlusScorer::ComputeScores(const CorpusStats& corpus, double term_weight, const double* term_freqs, const int* document_lengths,
+                                   double* scores, size_t count) const {
+    ComputeBm25Scores(GetSimdLevel(), {k1, b, delta, corpus.average_document_length, term_weight}, term_freqs, document_lengths, scores, count);
+}
+
+ScoreAccumulator::ScoreAccumulator(int first_id, int last_id, size_t expected_postings, std::pmr::memory_resource* resource)
+    : first_id_(first_id)
+    , is_dense_(false)
+    , dense_scores_(resource)
+    , dense_touched_(resource)
+    , sparse_scores_(resource)
+    , resource_(resource) {
+    if (last_id < first_id) {
+        return;
+    }
+    // Clearing and scanning the dense array costs as much as a few hash
+    // lookups per slot, so it only pays off when the range is not too sparse
+    const size_t range = static_cast<size_t>(static_cast<long long>(last_id) - first_id + 1);
+    is_dense_ = range <= 4096 || range <= 16 * expected_postings;
+    if (is_dense_) {
+        dense_scores_.assign(range, 0.0);
+        dense_touched_.assign(range, 0);
+    } else {
+        sparse_scores_.reserve(expected_postings);
+    }
+}
+
+void ScoreAccumulator::Add(const int* document_ids, const double* scores, size_t count) {
+    if (is_dense_) {
+        for (size_t i = 0; i < count; ++i) {
+            const size_t index = static_cast<size_t>(document_ids[i] - first_id_);
+            dense_scores_[index] += scores[i];
+            dense_touched_[index] = 1;
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        sparse_scores_[document_ids[i]] += scores[i];
+    }
+}
+
+void ScoreAccumulator::Exclude(int document_id) {
+    if (is_dense_) {
+        dense_touched_[static_cast<size_t>(document_id - first_id_)] = 0;
+    } else {
+        sparse_scores_.erase(document_id);
+    }
+}
+
+bool ScoreAccumulator::IsDense() const {
+    return is_dense_;
+}
+
+size_t ScoreAccumulator::GetSlotCount() const {
+    return is_dense_ ? dense_scores_.size() : sparse_scores_.size();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory_resource>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Relevance functions for SearchServer::FindTopDocuments. A scorer is a plain
+// value type whose functions are inlined into the posting loop, which is
+// instantiated once per scorer type.
+//
+// ComputeTermWeight is called once per query word with the number of documents
+// containing it; ComputeScore scores one posting of the word given the term
+// frequency normalized by the document length, as stored in the index.
+// ComputeScores does the same for a block of postings; the built-in scorers
+// use the widest SIMD instructions the CPU supports there.
+
+// Postings scored per ComputeScores call
+const size_t SCORE_BLOCK_SIZE = 128;
+
+struct CorpusStats {
+    int document_count = 0;
+    double average_document_length = 0.0;
+};
+
+// tf * log(N / df), the relevance the server has always used
+struct TfIdfScorer {
+    double ComputeTermWeight(const CorpusStats& corpus, int document_freq) const {
+        return std::log(corpus.document_count * 1.0 / document_freq);
+    }
+
+    double ComputeScore(const CorpusStats&, double term_weight, double term_freq, int) const {
+        return term_freq * term_weight;
+    }
+
+    void ComputeScores(const CorpusStats& corpus, double term_weight, const double* term_freqs, const int* document_lengths,
+                       double* scores, size_t count) const;
+};
+
+// Okapi BM25: term frequency saturates with k1, b controls how much long documents are penalized
+struct Bm25Scorer {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double ComputeTermWeight(const CorpusStats& corpus, int document_freq) const {
+        return std::log(1.0 + (corpus.document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    double ComputeScore(const CorpusStats& corpus, double term_weight, double term_freq, int document_length) const {
+        const double count = term_freq * document_length;
+        const double length_norm = k1 * (1.0 - b + b * document_length / corpus.average_document_length);
+        return term_weight * count * (k1 + 1.0) / (count + length_norm);
+    }
+
+    void ComputeScores(const CorpusStats& corpus, double term_weight, const double* term_freqs, const int* document_lengths,
+                       double* scores, size_t count) const;
+};
+
+// BM25+: adds delta to every match, so very long documents are not scored below non-matching ones
+struct Bm25PlusScorer {
+    double k1 = 1.2;
+    double b = 0.75;
+    double delta = 1.0;
+
+    double ComputeTermWeight(const CorpusStats& corpus, int document_freq) const {
+        return Bm25Scorer{k1, b}.ComputeTermWeight(corpus, document_freq);
+    }
+
+    double ComputeScore(const CorpusStats& corpus, double term_weight, double term_freq, int document_length) const {
+        return Bm25Scorer{k1, b}.ComputeScore(corpus, term_weight, term_freq, document_length) + term_weight * delta;
+    }
+
+    void ComputeScores(const CorpusStats& corpus, double term_weight, const double* term_freqs, const int* document_lengths,
+                       double* scores, size_t count) const;
+};
+
+// Scorer chosen at run time; dispatched once per query, not per posting
+using AnyScorer = std::variant<TfIdfScorer, Bm25Scorer, Bm25PlusScorer>;
+
+enum class SimdLevel {
+    SCALAR,
+    AVX2,
+    AVX512,
+};
+
+// Widest instructions the CPU supports, used by ComputeScores of the built-in
+// scorers; every narrower level is supported too
+SimdLevel GetSimdLevel();
+
+// ComputeScores of the scorer with the kernel of the given level, for comparing
+// the kernels. Every kernel returns bit-identical scores.
+void ComputeScores(const AnyScorer& scorer, SimdLevel level, const CorpusStats& corpus, double term_weight,
+                   const double* term_freqs, const int* document_lengths, double* scores, size_t count);
+
+// Sums the scores of the documents with ids in [first_id, last_id]. A dense
+// array indexed by id is used when the range is small compared to the number
+// of postings to add, a hash table otherwise.
+class ScoreAccumulator {
+public:
+    ScoreAccumulator(int first_id, int last_id, size_t expected_postings, std::pmr::memory_resource* resource);
+
+    void Add(const int* document_ids, const double* scores, size_t count);
+
+    void Exclude(int document_id);
+
+    bool IsDense() const;
+
+    // Score slots: the whole id range if dense, the touched documents otherwise
+    size_t GetSlotCount() const;
+
+    // Calls action(document_id, relevance) in ascending id order
+    template <typename Action>
+    void ForEach(Action action) const;
+
+private:
+    int first_id_;
+    bool is_dense_;
+    std::pmr::vector<double> dense_scores_;
+    // 1 for the documents present in dense_scores_
+    std::pmr::vector<char> dense_touched_;
+    std::pmr::unordered_map<int, double> sparse_scores_;
+    std::pmr::memory_resource* resource_;
+};
+
+template <typename Action>
+void ScoreAccumulator::ForEach(Action action) const {
+    if (is_dense_) {
+        for (size_t index = 0; index < dense_touched_.size(); ++index) {
+            if (dense_touched_[index]) {
+                action(first_id_ + static_cast<int>(index), dense_scores_[index]);
+            }
+        }
+        return;
+    }
+    std::pmr::vector<std::pair<int, double>> sorted(sparse_scores_.begin(), sparse_scores_.end(), resource_);
+    std::sort(sorted.begin(), sorted.end());
+    for (const auto& [document_id, relevance] : sorted) {
+        action(document_id, relevance);
+    }
+}
@@ -0,0 +1,312 @@
+#include "search_metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+struct ThreadTimer {
+    std::array<std::atomic<uint64_t>, LatencySnapshot::BUCKET_COUNT> buckets;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_nanoseconds;
+    std::atomic<uint64_t> max_nanoseconds;
+};
+
+// Written only by its thread, read by snapshots at any time
+struct ThreadMetrics {
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters;
+    std::array<ThreadTimer, METRIC_TIMER_COUNT> timers;
+};
+
+// A plain load and store instead of fetch_add: the owner is the only writer
+void AddRelaxed(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void AddTo(MetricsSnapshot& snapshot, const ThreadMetrics& metrics) {
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        snapshot.counters[i] += metrics.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < METRIC_TIMER_COUNT; ++i) {
+        const ThreadTimer& timer = metrics.timers[i];
+        LatencySnapshot& latency = snapshot.timers[i];
+        for (size_t bucket = 0; bucket < LatencySnapshot::BUCKET_COUNT; ++bucket) {
+            latency.buckets[bucket] += timer.buckets[bucket].load(std::memory_order_relaxed);
+        }
+        latency.count += timer.count.load(std::memory_order_relaxed);
+        latency.sum_nanoseconds += timer.sum_nanoseconds.load(std::memory_order_relaxed);
+        latency.max_nanoseconds = std::max(latency.max_nanoseconds, timer.max_nanoseconds.load(std::memory_order_relaxed));
+    }
+}
+
+class MetricsRegistry {
+public:
+    void Register(const ThreadMetrics* metrics) {
+        std::lock_guard lock(mutex_);
+        threads_.push_back(metrics);
+    }
+
+    // Keeps the totals of a finishing thread
+    void Retire(const ThreadMetrics* metrics) {
+        std::lock_guard lock(mutex_);
+        AddTo(retired_, *metrics);
+        threads_.erase(std::find(threads_.begin(), threads_.end(), metrics));
+    }
+
+    MetricsSnapshot GetSnapshot() {
+        std::lock_guard lock(mutex_);
+        MetricsSnapshot snapshot = retired_;
+        for (const ThreadMetrics* metrics : threads_) {
+            AddTo(snapshot, *metrics);
+        }
+        return snapshot;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<const ThreadMetrics*> threads_;
+    MetricsSnapshot retired_;
+};
+
+// Never destroyed: threads may finish during static destruction
+MetricsRegistry& GetRegistry() {
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return *registry;
+}
+
+class ThreadMetricsHolder {
+public:
+    ThreadMetricsHolder()
+        : metrics_(std::make_unique<ThreadMetrics>()) {
+        GetRegistry().Register(metrics_.get());
+    }
+
+    ~ThreadMetricsHolder() {
+        GetRegistry().Retire(metrics_.get());
+    }
+
+    ThreadMetrics& Get() {
+        return *metrics_;
+    }
+
+private:
+    std::unique_ptr<ThreadMetrics> metrics_;
+};
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetricsHolder holder;
+    return holder.Get();
+}
+
+const std::array<std::string_view, METRIC_COUNTER_COUNT> COUNTER_NAMES = {
+    "queries"sv,
+    "postings_scanned"sv,
+    "documents_matched"sv,
+    "documents_returned"sv,
+    "match_document_calls"sv,
+};
+
+const std::array<std::string_view, METRIC_TIMER_COUNT> TIMER_NAMES = {
+    "parse_query"sv,
+    "posting_scan"sv,
+    "accumulation"sv,
+    "top_k"sv,
+    "match_document"sv,
+};
+
+// Prometheus buckets: powers of two of nanoseconds, about 1 us to 69 s
+const int FIRST_EXPORTED_POWER = 10;
+const int LAST_EXPORTED_POWER = 36;
+
+double ToMicroseconds(std::chrono::nanoseconds latency) {
+    return std::chrono::duration<double, std::micro>(latency).count();
+}
+
+}  // namespace
+
+std::string_view GetMetricName(MetricCounter counter) {
+    return COUNTER_NAMES.at(static_cast<size_t>(counter));
+}
+
+std::string_view GetMetricName(MetricTimer timer) {
+    return TIMER_NAMES.at(static_cast<size_t>(timer));
+}
+
+size_t LatencySnapshot::GetBucketIndex(uint64_t nanoseconds) {
+    const uint64_t exact_limit = uint64_t{1} << SUB_BUCKET_BITS;
+    if (nanoseconds < exact_limit) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    // nanoseconds >> shift is in [exact_limit, 2 * exact_limit)
+    const int shift = 63 - __builtin_clzll(nanoseconds) - SUB_BUCKET_BITS;
+    return static_cast<size_t>(exact_limit + (static_cast<uint64_t>(shift) << SUB_BUCKET_BITS) + ((nanoseconds >> shift) - exact_limit));
+}
+
+uint64_t LatencySnapshot::GetBucketLimit(size_t index) {
+    const uint64_t exact_limit = uint64_t{1} << SUB_BUCKET_BITS;
+    if (index < exact_limit) {
+        return index + 1;
+    }
+    const int shift = static_cast<int>((index - exact_limit) >> SUB_BUCKET_BITS);
+    const uint64_t mantissa = (index - exact_limit) % exact_limit + exact_limit;
+    return (mantissa + 1) << shift;
+}
+
+std::chrono::nanoseconds LatencySnapshot::GetPercentile(double percent) const {
+    if (count == 0) {
+        return {};
+    }
+    const double clamped = std::clamp(percent, 0.0, 100.0);
+    const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(clamped / 100.0 * count)), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::chrono::nanoseconds(std::min(GetBucketLimit(i) - 1, max_nanoseconds));
+        }
+    }
+    return std::chrono::nanoseconds(max_nanoseconds);
+}
+
+bool ShouldSampleLatency() {
+    thread_local uint32_t countdown = 0;
+    if (countdown == 0) {
+        countdown = METRICS_LATENCY_SAMPLE_PERIOD - 1;
+        return true;
+    }
+    --countdown;
+    return false;
+}
+
+void IncrementMetric(MetricCounter counter, uint64_t value) {
+    AddRelaxed(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
+
+void RecordMetric(MetricTimer timer, std::chrono::nanoseconds latency) {
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+    ThreadTimer& thread_timer = GetThreadMetrics().timers[static_cast<size_t>(timer)];
+    AddRelaxed(thread_timer.buckets[LatencySnapshot::GetBucketIndex(nanoseconds)], 1);
+    AddRelaxed(thread_timer.count, 1);
+    AddRelaxed(thread_timer.sum_nanoseconds, nanoseconds);
+    if (nanoseconds > thread_timer.max_nanoseconds.load(std::memory_order_relaxed)) {
+        thread_timer.max_nanoseconds.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    return GetRegistry().GetSnapshot();
+}
+
+std::string ExportMetricsPrometheus(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        const std::string name = "search_server_"s + std::string(COUNTER_NAMES[i]) + "_total"s;
+        out << "# TYPE "s << name << " counter\n"s;
+        out << name << ' ' << snapshot.counters[i] << '\n';
+    }
+    for (size_t i = 0; i < METRIC_TIMER_COUNT; ++i) {
+        const std::string name = "search_server_"s + std::string(TIMER_NAMES[i]) + "_seconds"s;
+        const LatencySnapshot& latency = snapshot.timers[i];
+        out << "# TYPE "s << name << " histogram\n"s;
+        // A power of two is the limit of the bucket just below it
+        size_t bucket = 0;
+        uint64_t below = 0;
+        for (int power = FIRST_EXPORTED_POWER; power <= LAST_EXPORTED_POWER; ++power) {
+            const uint64_t limit = uint64_t{1} << power;
+            for (; LatencySnapshot::GetBucketLimit(bucket) <= limit; ++bucket) {
+                below += latency.buckets[bucket];
+            }
+            out << name << "_bucket{le=\""s << std::setprecision(10) << limit * 1e-9 << "\"} "s << below << '\n';
+        }
+        out << name << "_bucket{le=\"+Inf\"} "s << latency.count << '\n';
+        out << name << "_sum "s << std::setprecision(9) << latency.sum_nanoseconds * 1e-9 << '\n';
+        out << name << "_count "s << latency.count << '\n';
+    }
+    return out.str();
+}
+
+std::string ExportMetricsJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"counters\": {"s;
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        out << (i > 0 ? ", "s : ""s) << '"' << COUNTER_NAMES[i] << "\": "s << snapshot.counters[i];
+    }
+    out << "}, \"timers\": {"s;
+    for (size_t i = 0; i < METRIC_TIMER_COUNT; ++i) {
+        const LatencySnapshot& latency = snapshot.timers[i];
+        const double mean = latency.count == 0 ? 0.0 : ToMicroseconds(std::chrono::nanoseconds(latency.sum_nanoseconds)) / latency.count;
+        out << (i > 0 ? ", "s : ""s) << '"' << TIMER_NAMES[i] << "\": {"s
+            << "\"count\": "s << latency.count
+            << ", \"mean_us\": "s << mean
+            << ", \"p50_us\": "s << ToMicroseconds(latency.GetPercentile(50))
+            << ", \"p90_us\": "s << ToMicroseconds(latency.GetPercentile(90))
+            << ", \"p99_us\": "s << ToMicroseconds(latency.GetPercentile(99))
+            << ", \"p999_us\": "s << ToMicroseconds(latency.GetPercentile(99.9))
+            << ", \"max_us\": "s << ToMicroseconds(std::chrono::nanoseconds(latency.max_nanoseconds)) << '}';
+    }
+    out << "}}\n"s;
+    return out.str();
+}
+
+void WriteMetrics(const std::string& path, MetricsFormat format) {
+    const MetricsSnapshot snapshot = GetMetricsSnapshot();
+    const std::string text = format == MetricsFormat::PROMETHEUS ? ExportMetricsPrometheus(snapshot) : ExportMetricsJson(snapshot);
+    const std::string temporary_path = path + ".tmp"s;
+    {
+        std::ofstream out(temporary_path, std::ios::binary);
+        if (!(out << text) || !out.flush()) {
+            throw std::runtime_error("Cannot write "s + temporary_path);
+        }
+    }
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace "s + path);
+    }
+}
+
+MetricsStopwatch::MetricsStopwatch(bool enabled)
+    : enabled_(enabled) {
+    if (enabled_) {
+        lap_start_ = std::chrono::steady_clock::now();
+    }
+}
+
+bool MetricsStopwatch::IsEnabled() const {
+    return enabled_;
+}
+
+void MetricsStopwatch::Lap(MetricTimer timer) {
+    if (!enabled_) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    RecordMetric(timer, now - lap_start_);
+    lap_start_ = now;
+}
+
+void MetricsStopwatch::Restart() {
+    if (enabled_) {
+        lap_start_ = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedMetricsTimer::ScopedMetricsTimer(MetricTimer timer, bool enabled)
+    : timer_(timer)
+    , stopwatch_(enabled) {
+}
+
+ScopedMetricsTimer::~ScopedMetricsTimer() {
+    stopwatch_.Lap(timer_);
+}
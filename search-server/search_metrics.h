@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Process-wide counters and latency histograms of the query hot paths, cheap
+// enough to stay enabled in production. Every thread writes to its own block
+// of relaxed atomics, so recording takes no lock and no read-modify-write
+// instruction. Snapshots sum the blocks of all threads, alive or finished.
+// Counters count every operation, histograms a sample of them.
+
+enum class MetricCounter {
+    QUERIES,
+    // Posting list entries read by the scoring loop, including candidate probes
+    POSTINGS_SCANNED,
+    // Documents that got a score and passed the predicate
+    DOCUMENTS_MATCHED,
+    DOCUMENTS_RETURNED,
+    MATCH_DOCUMENT_CALLS,
+    COUNT,
+};
+
+enum class MetricTimer {
+    PARSE_QUERY,
+    // Scoring the postings of plus words and excluding minus words, per shard
+    POSTING_SCAN,
+    // Collecting the scored documents from the accumulators
+    ACCUMULATION,
+    TOP_K,
+    MATCH_DOCUMENT,
+    COUNT,
+};
+
+const size_t METRIC_COUNTER_COUNT = static_cast<size_t>(MetricCounter::COUNT);
+const size_t METRIC_TIMER_COUNT = static_cast<size_t>(MetricTimer::COUNT);
+
+std::string_view GetMetricName(MetricCounter counter);
+
+std::string_view GetMetricName(MetricTimer timer);
+
+// Latencies in log-linear buckets: 8 per power of two of nanoseconds, so the
+// reported percentiles are within 12.5% of the recorded values
+struct LatencySnapshot {
+    static const int SUB_BUCKET_BITS = 3;
+    static const size_t BUCKET_COUNT = 64 << SUB_BUCKET_BITS;
+
+    std::array<uint64_t, BUCKET_COUNT> buckets = {};
+    uint64_t count = 0;
+    uint64_t sum_nanoseconds = 0;
+    uint64_t max_nanoseconds = 0;
+
+    static size_t GetBucketIndex(uint64_t nanoseconds);
+
+    // The first value past the bucket
+    static uint64_t GetBucketLimit(size_t index);
+
+    std::chrono::nanoseconds GetPercentile(double percent) const;
+};
+
+struct MetricsSnapshot {
+    std::array<uint64_t, METRIC_COUNTER_COUNT> counters = {};
+    std::array<LatencySnapshot, METRIC_TIMER_COUNT> timers;
+};
+
+// Stage latencies are timed for one in this many operations of a thread:
+// reading the clock costs more than the rest of the bookkeeping together
+const uint32_t METRICS_LATENCY_SAMPLE_PERIOD = 16;
+
+// True for one in METRICS_LATENCY_SAMPLE_PERIOD calls on a thread
+bool ShouldSampleLatency();
+
+void IncrementMetric(MetricCounter counter, uint64_t value = 1);
+
+void RecordMetric(MetricTimer timer, std::chrono::nanoseconds latency);
+
+MetricsSnapshot GetMetricsSnapshot();
+
+// Prometheus text exposition format. Histogram buckets are the powers of two
+// of nanoseconds from about a microsecond to a minute.
+std::string ExportMetricsPrometheus(const MetricsSnapshot& snapshot);
+
+// Counters and, per timer, count, mean, max and percentiles in microseconds
+std::string ExportMetricsJson(const MetricsSnapshot& snapshot);
+
+enum class MetricsFormat {
+    PROMETHEUS,
+    JSON,
+};
+
+// Replaces the file atomically, so a scraper never reads a partial export
+void WriteMetrics(const std::string& path, MetricsFormat format);
+
+// Times consecutive stages of an operation with one clock read per stage.
+// Does nothing, not even reading the clock, when disabled.
+class MetricsStopwatch {
+public:
+    explicit MetricsStopwatch(bool enabled);
+
+    bool IsEnabled() const;
+
+    // Records the time since the previous lap or restart
+    void Lap(MetricTimer timer);
+
+    // Starts the next lap without recording the time spent since the previous one
+    void Restart();
+
+private:
+    bool enabled_;
+    std::chrono::steady_clock::time_point lap_start_;
+};
+
+// Records the lifetime of the scope, whatever way it is left
+class ScopedMetricsTimer {
+public:
+    ScopedMetricsTimer(MetricTimer timer, bool enabled);
+
+    ScopedMetricsTimer(const ScopedMetricsTimer&) = delete;
+    ScopedMetricsTimer& operator=(const ScopedMetricsTimer&) = delete;
+
+    ~ScopedMetricsTimer();
+
+private:
+    MetricTimer timer_;
+    MetricsStopwatch stopwatch_;
+};
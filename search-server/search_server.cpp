@@ -1,10 +1,22 @@
 #include "search_server.h"
 
-SearchServer::SearchServer(const std::string& stop_words_text) : SearchServer(SplitIntoWords(stop_words_text))
+SearchServer::SearchServer(const std::string& stop_words_text, std::pmr::memory_resource* index_resource)
+    : SearchServer(SplitIntoWords(stop_words_text), index_resource)
 {
 }
 
-SearchServer::SearchServer(const std::string_view stop_words_text) : SearchServer(SplitIntoWords(stop_words_text))
+SearchServer::SearchServer(const std::string_view stop_words_text, std::pmr::memory_resource* index_resource)
+    : SearchServer(SplitIntoWords(stop_words_text), index_resource)
+{
+}
+
+SearchServer::SearchServer(const std::string& stop_words_text, const SearchServerOptions& options, std::pmr::memory_resource* index_resource)
+    : SearchServer(SplitIntoWords(stop_words_text), options, index_resource)
+{
+}
+
+SearchServer::SearchServer(const std::string_view stop_words_text, const SearchServerOptions& options, std::pmr::memory_resource* index_resource)
+    : SearchServer(SplitIntoWords(stop_words_text), options, index_resource)
 {
 }
 
@@ -13,17 +25,80 @@ void SearchServer::AddDocument(int document_id,const std::string_view document,
         throw std::invalid_argument("Invalid document_id"s);
     }
 
-    const auto words = SplitIntoWordsNoStop(document);
+    QueryArena::Scope arena;
+    std::vector<int> positions;
+    const auto words = SplitIntoWordsNoStop(document, arena.Resource(), options_.store_positions ? &positions : nullptr);
+
+    std::vector<std::string_view> distinct_words(words);
+    DeleteCopy(distinct_words);
+    uint64_t word_set_fingerprint = 0;
+    for (const std::string_view word : distinct_words) {
+        word_set_fingerprint += HashWord(word);
+    }
+
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        if (const auto duplicate_of = FindStoredDuplicate(word_set_fingerprint, distinct_words)) {
+            if (duplicate_handler_) {
+                duplicate_handler_(document_id, *duplicate_of);
+            }
+            if (duplicate_policy_ == DuplicatePolicy::REJECT) {
+                throw std::invalid_argument("Document "s + std::to_string(document_id) + " duplicates document "s + std::to_string(*duplicate_of));
+            }
+            if (duplicate_policy_ == DuplicatePolicy::REPLACE) {
+                RemoveDocument(*duplicate_of);
+            }
+        }
+    }
 
     const double inv_word_count = 1.0 / words.size();
 
-    for (auto iter = words.begin(); iter != words.end(); ++iter) {
-        dictionary_.push_back(std::string(*iter));
-        word_to_document_freqs_[dictionary_.back()][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][dictionary_.back()] += inv_word_count;
+    // (word id, frequency, index in distinct_words)
+    std::vector<std::tuple<WordId, double, size_t>> word_freqs;
+    word_freqs.reserve(distinct_words.size());
+    for (const std::string_view word : distinct_words) {
+        word_freqs.emplace_back(AddWord(word), 0.0, word_freqs.size());
+    }
+    std::vector<std::vector<int>> word_positions(positions.empty() ? 0 : distinct_words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        const auto index = std::lower_bound(distinct_words.begin(), distinct_words.end(), words[i]) - distinct_words.begin();
+        std::get<double>(word_freqs[index]) += inv_word_count;
+        if (!positions.empty()) {
+            word_positions[index].push_back(positions[i]);
+        }
+    }
+    std::sort(word_freqs.begin(), word_freqs.end());
+
+    const size_t words_offset = document_word_ids_.size();
+    for (const auto& [word_id, freq, index] : word_freqs) {
+        words_[word_id].postings.Insert(document_id, freq, static_cast<int>(words.size()));
+        document_word_ids_.push_back(word_id);
+        document_word_freqs_.push_back(freq);
+        if (!positions.empty()) {
+            AppendPositions(word_positions[index]);
+        }
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+
+    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, word_set_fingerprint, words_offset, word_freqs.size(),
+                                                    static_cast<int>(words.size())});
+    total_document_length_ += words.size();
     document_ids_.insert(document_id);
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        IndexFingerprint(document_id);
+    }
+}
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy policy, DuplicateHandler handler) {
+    const bool was_indexed = duplicate_policy_ != DuplicatePolicy::ALLOW;
+    duplicate_policy_ = policy;
+    duplicate_handler_ = std::move(handler);
+
+    if (policy == DuplicatePolicy::ALLOW) {
+        fingerprint_to_document_ids_.clear();
+    } else if (!was_indexed) {
+        for (const int document_id : document_ids_) {
+            IndexFingerprint(document_id);
+        }
+    }
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
@@ -36,29 +111,161 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_
     return FindTopDocuments(std::execution::seq ,raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, const QueryOptions& query_options) const {
+    return FindTopDocuments(std::execution::seq, raw_query, [](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == DocumentStatus::ACTUAL;
+    }, query_options);
+}
+
+QueryCost SearchServer::EstimateQueryCost(const std::string_view raw_query) const {
+    QueryArena::Scope arena;
+    return GetQueryCost(ParseQuery(raw_query, std::execution::seq, arena.Resource()));
+}
+
+void SearchServer::SetScorer(const AnyScorer& scorer) {
+    scorer_ = scorer;
+}
+
+void SearchServer::SetSlowQueryLog(std::shared_ptr<SlowQueryLog> slow_query_log) {
+    slow_query_log_ = std::move(slow_query_log);
+}
+
+std::vector<std::string> SearchServer::FindWordsByPrefix(std::string_view prefix, size_t max_count) const {
+    QueryArena::Scope arena;
+    std::vector<std::string> result;
+    const std::string_view normalized_prefix = NormalizeWord(prefix, options_.normalization, {}, arena.Resource());
+    for (const auto& [document_count, word] : FindMatchingWords(normalized_prefix, {}, max_count, arena.Resource())) {
+        result.emplace_back(word);
+    }
+    return result;
+}
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    const static std::map<std::string_view, double> word_freqs_;
+CorpusStats SearchServer::GetCorpusStats() const {
+    if (documents_.empty()) {
+        return {};
+    }
+    return {GetDocumentCount(), total_document_length_ * 1.0 / documents_.size()};
+}
 
-    if (document_to_word_freqs_.count(document_id) == 1) {
-        return document_to_word_freqs_.at(document_id);
+SearchServer::WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto document = documents_.find(document_id);
+    if (document == documents_.end()) {
+        return {this, nullptr, nullptr, 0};
     }
-    return word_freqs_;
+    const DocumentData& data = document->second;
+    return {this, document_word_ids_.data() + data.words_offset, document_word_freqs_.data() + data.words_offset, data.word_count};
+}
+
+uint64_t SearchServer::GetWordSetFingerprint(int document_id) const {
+    return documents_.at(document_id).word_set_fingerprint;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    documents_.erase(document_id);
+    if (documents_.count(document_id) == 0) {
+        return;
+    }
+
+    const DocumentData& document = documents_.at(document_id);
+    for (size_t i = document.words_offset; i < document.words_offset + document.word_count; ++i) {
+        words_[document_word_ids_[i]].postings.Erase(document_id);
+        ReclaimWordIfUnused(document_word_ids_[i]);
+    }
+    removed_word_entries_ += document.word_count;
+    total_document_length_ -= document.length;
 
+    ForgetFingerprint(document_id);
+    documents_.erase(document_id);
     document_ids_.erase(document_id);
+    if (removed_word_entries_ > document_word_ids_.size() / 2) {
+        CompactForwardIndex();
+    }
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    RemoveDocuments(std::execution::seq, document_ids);
+}
+
+void SearchServer::Compact() {
+    // A pmr container keeps its memory resource for life, so the index is copied
+    // aside, the emptied pool hands its chunks back, and the index is copied
+    // back into densely allocated nodes. Word ids are renumbered in text order
+    // on the way, which drops the free slots.
+    std::pmr::monotonic_buffer_resource scratch;
+    Dictionary dictionary(&scratch);
+    std::pmr::vector<WordData> words(&scratch);
+    std::vector<WordId> new_word_ids(words_.size());
+    for (const auto& [text, word_id] : dictionary_) {
+        new_word_ids[word_id] = static_cast<WordId>(words.size());
+        dictionary.emplace_hint(dictionary.end(), text, static_cast<WordId>(words.size()));
+        words.push_back(words_[word_id]);
+    }
 
-    for (const auto& [word, freq]: document_to_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+    std::pmr::map<int, DocumentData> documents(documents_, &scratch);
+    std::pmr::vector<WordId> document_word_ids(&scratch);
+    std::pmr::vector<double> document_word_freqs(&scratch);
+    std::pmr::vector<size_t> document_position_offsets(&scratch);
+    std::pmr::vector<unsigned char> position_bytes(&scratch);
+    document_word_ids.reserve(document_word_ids_.size() - removed_word_entries_);
+    document_word_freqs.reserve(document_word_ids_.size() - removed_word_entries_);
+    // (new word id, frequency, forward index entry)
+    std::vector<std::tuple<WordId, double, size_t>> word_freqs;
+    for (auto& [document_id, document] : documents) {
+        word_freqs.clear();
+        for (size_t i = document.words_offset; i < document.words_offset + document.word_count; ++i) {
+            word_freqs.emplace_back(new_word_ids[document_word_ids_[i]], document_word_freqs_[i], i);
+        }
+        std::sort(word_freqs.begin(), word_freqs.end());
+        document.words_offset = document_word_ids.size();
+        for (const auto& [word_id, freq, entry] : word_freqs) {
+            document_word_ids.push_back(word_id);
+            document_word_freqs.push_back(freq);
+            if (options_.store_positions) {
+                const auto positions = position_bytes_.begin() + document_position_offsets_[entry];
+                document_position_offsets.push_back(position_bytes.size());
+                position_bytes.insert(position_bytes.end(), positions, positions + GetPositionListSize(document_position_offsets_[entry]));
+            }
+        }
+    }
+    std::pmr::set<int> document_ids(document_ids_, &scratch);
+
+    // Vectors and unordered maps keep their storage on clear(), so every member
+    // is swapped with an empty one to leave nothing allocated from the pool
+    decltype(dictionary_)(index_resource_).swap(dictionary_);
+    decltype(words_)(index_resource_).swap(words_);
+    decltype(free_word_ids_)(index_resource_).swap(free_word_ids_);
+    decltype(documents_)(index_resource_).swap(documents_);
+    decltype(document_word_ids_)(index_resource_).swap(document_word_ids_);
+    decltype(document_word_freqs_)(index_resource_).swap(document_word_freqs_);
+    decltype(document_position_offsets_)(index_resource_).swap(document_position_offsets_);
+    decltype(position_bytes_)(index_resource_).swap(position_bytes_);
+    decltype(document_ids_)(index_resource_).swap(document_ids_);
+    decltype(fingerprint_to_document_ids_)(index_resource_).swap(fingerprint_to_document_ids_);
+    if (own_index_resource_) {
+        own_index_resource_->release();
     }
 
-    document_to_word_freqs_.erase(document_id);
+    dictionary_.insert(dictionary.begin(), dictionary.end());
+    words_.reserve(words.size());
+    words_.insert(words_.end(), words.begin(), words.end());
+    for (const auto& [text, word_id] : dictionary_) {
+        words_[word_id].text = text;
+    }
+    documents_.insert(documents.begin(), documents.end());
+    document_word_ids_.assign(document_word_ids.begin(), document_word_ids.end());
+    document_word_freqs_.assign(document_word_freqs.begin(), document_word_freqs.end());
+    document_position_offsets_.assign(document_position_offsets.begin(), document_position_offsets.end());
+    position_bytes_.assign(position_bytes.begin(), position_bytes.end());
+    removed_word_entries_ = 0;
+    document_ids_.insert(document_ids.begin(), document_ids.end());
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        for (const int document_id : document_ids_) {
+            IndexFingerprint(document_id);
+        }
+    }
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
@@ -66,27 +273,52 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     {
         throw std::out_of_range("no document"s);
     }
+    ScopedMetricsTimer timer(MetricTimer::MATCH_DOCUMENT, options_.collect_metrics && ShouldSampleLatency());
+    if (options_.collect_metrics) {
+        IncrementMetric(MetricCounter::MATCH_DOCUMENT_CALLS);
+    }
 
-    const auto query = ParseQuery(raw_query, std::execution::seq);
+    QueryArena::Scope arena;
+    const auto query = ParseQuery(raw_query, std::execution::seq, arena.Resource());
 
     std::vector<std::string_view> matched_words;
     for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const WordData* word_data = FindWord(word);
+        if (word_data == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (word_data->postings.Contains(document_id)) {
             return { matched_words, documents_.at(document_id).status };
         }
     }
+    if (!MatchesRestrictions(query, document_id, arena.Resource())) {
+        return { matched_words, documents_.at(document_id).status };
+    }
 
     for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const WordData* word_data = FindWord(word);
+        if (word_data == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (word_data->postings.Contains(document_id)) {
+            matched_words.push_back(word_data->text);
+        }
+    }
+    for (const auto& expansions : query.pattern_expansions) {
+        for (const std::string_view word : expansions) {
+            if (FindWord(word)->postings.Contains(document_id)) {
+                matched_words.push_back(word);
+            }
+        }
+    }
+    for (const auto& [word, distance] : query.fuzzy_words) {
+        if (FindWord(word)->postings.Contains(document_id)) {
             matched_words.push_back(word);
         }
     }
+    if (!query.pattern_expansions.empty() || !query.fuzzy_words.empty()) {
+        DeleteCopy(matched_words);
+    }
     
     return {matched_words, documents_.at(document_id).status};
 }
@@ -100,64 +332,282 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     {
         throw std::out_of_range("no document"s);
     }
+    ScopedMetricsTimer timer(MetricTimer::MATCH_DOCUMENT, options_.collect_metrics && ShouldSampleLatency());
+    if (options_.collect_metrics) {
+        IncrementMetric(MetricCounter::MATCH_DOCUMENT_CALLS);
+    }
 
-    const auto query = ParseQuery(raw_query, std::execution::par);
+    QueryArena::Scope arena;
+    const auto query = ParseQuery(raw_query, std::execution::par, arena.Resource());
     
     std::vector<std::string_view> matched_words;
 
     if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [this, document_id](const std::string_view word) {
-        return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id) == 1;
+        const WordData* word_data = FindWord(word);
+        return word_data != nullptr && word_data->postings.Contains(document_id);
         }))
     {
         return { matched_words, documents_.at(document_id).status };
     }
+    if (!MatchesRestrictions(query, document_id, arena.Resource())) {
+        return { matched_words, documents_.at(document_id).status };
+    }
 
     matched_words.resize(query.plus_words.size());
 
     auto last_element = std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [this, document_id](const std::string_view word) {
-         return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id) == 1;
+         const WordData* word_data = FindWord(word);
+        return word_data != nullptr && word_data->postings.Contains(document_id);
         });
     matched_words.erase(last_element, matched_words.end());
+    // Query words may live in the query arena, dictionary words outlive the call
+    for (std::string_view& word : matched_words) {
+        word = FindWord(word)->text;
+    }
+    for (const auto& expansions : query.pattern_expansions) {
+        for (const std::string_view word : expansions) {
+            if (FindWord(word)->postings.Contains(document_id)) {
+                matched_words.push_back(word);
+            }
+        }
+    }
+    for (const auto& [word, distance] : query.fuzzy_words) {
+        if (FindWord(word)->postings.Contains(document_id)) {
+            matched_words.push_back(word);
+        }
+    }
     DeleteCopy(matched_words);
 
     return { matched_words, documents_.at(document_id).status };
 }
 
-std::set<int>::iterator SearchServer::begin() {
+std::pmr::set<int>::iterator SearchServer::begin() {
+    return document_ids_.begin();
+}
+
+std::pmr::set<int>::iterator SearchServer::end() {
+    return document_ids_.end();
+}
+
+std::pmr::set<int>::const_iterator SearchServer::begin() const {
     return document_ids_.begin();
 }
 
-std::set<int>::iterator SearchServer::end() {
+std::pmr::set<int>::const_iterator SearchServer::end() const {
     return document_ids_.end();
 }
 
-const std::set<int>::iterator SearchServer::begin_const() {
+const std::pmr::set<int>::iterator SearchServer::begin_const() {
     return document_ids_.begin();
 }
 
-const std::set<int>::iterator SearchServer::end_const() {
+const std::pmr::set<int>::iterator SearchServer::end_const() {
     return document_ids_.end();
 }
 
+const SearchServer::WordData* SearchServer::FindWord(const std::string_view word) const {
+    const auto entry = dictionary_.find(word);
+    return entry == dictionary_.end() ? nullptr : &words_[entry->second];
+}
+
+SearchServer::WordId SearchServer::AddWord(const std::string_view word) {
+    if (const auto entry = dictionary_.find(word); entry != dictionary_.end()) {
+        return entry->second;
+    }
+    WordId word_id;
+    if (free_word_ids_.empty()) {
+        word_id = static_cast<WordId>(words_.size());
+        words_.emplace_back();
+    } else {
+        word_id = free_word_ids_.back();
+        free_word_ids_.pop_back();
+    }
+    words_[word_id].text = dictionary_.emplace(word, word_id).first->first;
+    return word_id;
+}
+
+void SearchServer::ReclaimWordIfUnused(WordId word_id) {
+    WordData& word = words_[word_id];
+    if (!word.postings.empty()) {
+        return;
+    }
+    dictionary_.erase(dictionary_.find(word.text));
+    word.text = {};
+    free_word_ids_.push_back(word_id);
+}
+
+void SearchServer::CompactForwardIndex() {
+    std::pmr::vector<WordId> document_word_ids(index_resource_);
+    std::pmr::vector<double> document_word_freqs(index_resource_);
+    std::pmr::vector<size_t> document_position_offsets(index_resource_);
+    std::pmr::vector<unsigned char> position_bytes(index_resource_);
+    document_word_ids.reserve(document_word_ids_.size() - removed_word_entries_);
+    document_word_freqs.reserve(document_word_ids_.size() - removed_word_entries_);
+    for (auto& [document_id, document] : documents_) {
+        const size_t words_end = document.words_offset + document.word_count;
+        const size_t words_offset = document_word_ids.size();
+        document_word_ids.insert(document_word_ids.end(), document_word_ids_.begin() + document.words_offset, document_word_ids_.begin() + words_end);
+        document_word_freqs.insert(document_word_freqs.end(), document_word_freqs_.begin() + document.words_offset, document_word_freqs_.begin() + words_end);
+        if (options_.store_positions) {
+            for (size_t entry = document.words_offset; entry < words_end; ++entry) {
+                const auto positions = position_bytes_.begin() + document_position_offsets_[entry];
+                document_position_offsets.push_back(position_bytes.size());
+                position_bytes.insert(position_bytes.end(), positions, positions + GetPositionListSize(document_position_offsets_[entry]));
+            }
+        }
+        document.words_offset = words_offset;
+    }
+    document_word_ids_.swap(document_word_ids);
+    document_word_freqs_.swap(document_word_freqs);
+    document_position_offsets_.swap(document_position_offsets);
+    position_bytes_.swap(position_bytes);
+    removed_word_entries_ = 0;
+}
+
+void SearchServer::AppendPositions(const std::vector<int>& positions) {
+    document_position_offsets_.push_back(position_bytes_.size());
+    AppendVarint(position_bytes_, static_cast<uint32_t>(positions.size()));
+    int previous = 0;
+    for (const int position : positions) {
+        AppendVarint(position_bytes_, static_cast<uint32_t>(position - previous));
+        previous = position;
+    }
+}
+
+size_t SearchServer::GetPositionListSize(size_t offset) const {
+    const unsigned char* const first = position_bytes_.data() + offset;
+    const unsigned char* data = first;
+    for (uint32_t count = ReadVarint(data); count > 0; --count) {
+        ReadVarint(data);
+    }
+    return data - first;
+}
+
+bool SearchServer::DecodeWordPositions(const DocumentData& document, const std::string_view word, std::pmr::vector<int>& positions) const {
+    const auto entry = dictionary_.find(word);
+    if (entry == dictionary_.end()) {
+        return false;
+    }
+    const WordId* const first = document_word_ids_.data() + document.words_offset;
+    const WordId* const last = first + document.word_count;
+    const WordId* const word_id = std::lower_bound(first, last, entry->second);
+    if (word_id == last || *word_id != entry->second) {
+        return false;
+    }
+
+    const unsigned char* data = position_bytes_.data() + document_position_offsets_[word_id - document_word_ids_.data()];
+    positions.resize(ReadVarint(data));
+    int position = 0;
+    for (int& decoded : positions) {
+        position += static_cast<int>(ReadVarint(data));
+        decoded = position;
+    }
+    return true;
+}
+
+std::optional<int> SearchServer::FindStoredDuplicate(uint64_t word_set_fingerprint, const std::vector<std::string_view>& distinct_words) const {
+    const auto candidates = fingerprint_to_document_ids_.find(word_set_fingerprint);
+    if (candidates == fingerprint_to_document_ids_.end()) {
+        return std::nullopt;
+    }
+
+    // A document with a word unknown to the index cannot have a stored duplicate
+    std::vector<WordId> word_ids;
+    word_ids.reserve(distinct_words.size());
+    for (const std::string_view word : distinct_words) {
+        const auto entry = dictionary_.find(word);
+        if (entry == dictionary_.end()) {
+            return std::nullopt;
+        }
+        word_ids.push_back(entry->second);
+    }
+    std::sort(word_ids.begin(), word_ids.end());
+
+    for (const int candidate_id : candidates->second) {
+        const WordFrequencies word_freqs = GetWordFrequencies(candidate_id);
+        if (word_freqs.size() == word_ids.size() && std::equal(word_ids.begin(), word_ids.end(), word_freqs.word_ids())) {
+            return candidate_id;
+        }
+    }
+    return std::nullopt;
+}
+
+void SearchServer::IndexFingerprint(int document_id) {
+    fingerprint_to_document_ids_[documents_.at(document_id).word_set_fingerprint].push_back(document_id);
+}
+
+void SearchServer::ForgetFingerprint(int document_id) {
+    if (fingerprint_to_document_ids_.empty()) {
+        return;
+    }
+    const auto candidates = fingerprint_to_document_ids_.find(documents_.at(document_id).word_set_fingerprint);
+    if (candidates == fingerprint_to_document_ids_.end()) {
+        return;
+    }
+    auto& ids = candidates->second;
+    ids.erase(std::remove(ids.begin(), ids.end(), document_id), ids.end());
+    if (ids.empty()) {
+        fingerprint_to_document_ids_.erase(candidates);
+    }
+}
+
 bool SearchServer::IsStopWord(const std::string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
+std::string_view SearchServer::Stem(const std::string_view word, std::pmr::memory_resource* resource, QueryTrace* trace) const {
+    if (!stem_cache_) {
+        return word;
+    }
+    if (!trace) {
+        return stem_cache_->Stem(word, resource);
+    }
+    bool cache_hit = false;
+    const std::string_view stem = stem_cache_->Stem(word, resource, &cache_hit);
+    ++(cache_hit ? trace->stem_cache_hits : trace->stem_cache_misses);
+    return stem;
+}
+
+std::set<std::string, std::less<>> SearchServer::NormalizeStopWords(const std::set<std::string, std::less<>>& stop_words,
+                                                                    const NormalizationOptions& options) {
+    std::pmr::monotonic_buffer_resource scratch;
+    std::set<std::string, std::less<>> normalized_stop_words;
+    for (const std::string& word : stop_words) {
+        const std::string_view normalized = NormalizeWord(word, options, {}, &scratch);
+        if (!normalized.empty()) {
+            normalized_stop_words.emplace(normalized);
+        }
+    }
+    return normalized_stop_words;
+}
+
 bool SearchServer::IsValidWord(const std::string_view word) {
     return std::none_of(word.begin(), word.end(), [](char c) {
         return c >= '\0' && c < ' ';
     });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
+std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::pmr::memory_resource* resource,
+                                                                 std::vector<int>* positions) const {
     std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+    // Most text needs no normalization, which one vectorized pass can tell
+    const bool is_plain = IsPlainLowercaseText(text);
+    int position = 0;
+    for (const std::string_view raw_word : SplitIntoWords(text)) {
+        if (!IsValidWord(raw_word)) {
+            throw std::invalid_argument("Word "s + std::string(raw_word) + " is invalid"s);
+        }
+        const std::string_view word = is_plain ? raw_word : NormalizeWord(raw_word, options_.normalization, {}, resource);
+        if (word.empty()) {
+            continue;
         }
         if (!IsStopWord(word)) {
-            words.push_back(word);
+            words.push_back(Stem(word, resource));
+            if (positions) {
+                positions->push_back(position);
+            }
         }
+        ++position;
     }
     return words;
 }
@@ -174,32 +624,384 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 }
 
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text, std::pmr::memory_resource* resource, QueryTrace* trace) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty"s);
     }
     std::string_view word = text;
     bool is_minus = false;
+    bool is_required = false;
     if (word[0] == '-') {
         is_minus = true;
         word = word.substr(1);
+    } else if (word[0] == '+') {
+        is_required = true;
+        word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || word[0] == '+' || !IsValidWord(word)) {
         throw std::invalid_argument("Query word "s + std::string(text) + " is invalid"s);
     }
+    // Wildcards and the fuzzy suffix are query syntax, not punctuation
+    word = NormalizeWord(word, options_.normalization, "*?~"sv, resource);
+    if (word.empty() || IsStopWord(word)) {
+        return {word, is_minus, is_required, true};
+    }
+    std::string_view unsuffixed = word;
+    if (!IsWildcardPattern(word) && !ParseFuzzySuffix(unsuffixed)) {
+        word = Stem(word, resource, trace);
+    }
+
+    return {word, is_minus, is_required, false};
+}
+
+std::pmr::vector<std::pair<size_t, std::string_view>> SearchServer::FindMatchingWords(const std::string_view prefix, const std::string_view pattern,
+                                                                                      size_t max_count, std::pmr::memory_resource* resource) const {
+    // The dictionary is ordered, so the words with the prefix form one range
+    std::pmr::vector<std::pair<size_t, std::string_view>> matches(resource);
+    size_t scanned = 0;
+    for (auto entry = dictionary_.lower_bound(prefix); entry != dictionary_.end(); ++entry) {
+        const std::string_view word = entry->first;
+        if (word.substr(0, prefix.size()) != prefix || scanned++ == options_.max_pattern_scan) {
+            break;
+        }
+        if (pattern.empty() || MatchesWildcard(pattern, word)) {
+            matches.emplace_back(words_[entry->second].postings.size(), word);
+        }
+    }
+
+    const auto more_frequent = [](const std::pair<size_t, std::string_view>& lhs, const std::pair<size_t, std::string_view>& rhs) {
+        return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+    };
+    if (matches.size() > max_count) {
+        std::nth_element(matches.begin(), matches.begin() + max_count, matches.end(), more_frequent);
+        matches.resize(max_count);
+    }
+    std::sort(matches.begin(), matches.end(), more_frequent);
+    return matches;
+}
+
+void SearchServer::ExpandPattern(const std::string_view pattern, std::pmr::vector<std::string_view>& words) const {
+    const std::string_view prefix = pattern.substr(0, pattern.find_first_of("*?"sv));
+    const auto matches = FindMatchingWords(prefix, pattern, options_.max_pattern_expansions, words.get_allocator().resource());
+    for (const auto& [document_count, word] : matches) {
+        words.push_back(word);
+    }
+}
+
+void SearchServer::ExpandFuzzyWord(const std::string_view word, int max_distance, std::pmr::vector<std::pair<std::string_view, int>>& words) const {
+    // Levenshtein DP over the ordered dictionary: row d holds the distances
+    // between the first d characters of a dictionary word and every prefix of
+    // the query word. Neighbouring words share prefixes, so rows are reused up
+    // to the common prefix, and once every cell of a row exceeds max_distance
+    // the whole range of words with that prefix is skipped.
+    std::pmr::memory_resource* const resource = words.get_allocator().resource();
+    const size_t row_size = word.size() + 1;
+    std::pmr::vector<int> rows(row_size, resource);
+    for (size_t i = 0; i < row_size; ++i) {
+        rows[i] = static_cast<int>(i);
+    }
+
+    // (distance, -document count, word) to keep the closest and most frequent
+    std::pmr::vector<std::tuple<int, long long, std::string_view>> matches(resource);
+    std::string_view previous;
+    size_t valid_depth = 0;
+    auto entry = dictionary_.begin();
+    while (entry != dictionary_.end()) {
+        const std::string_view candidate = entry->first;
+        size_t depth = 0;
+        while (depth < valid_depth && depth < candidate.size() && previous[depth] == candidate[depth]) {
+            ++depth;
+        }
+        if (rows.size() < (candidate.size() + 1) * row_size) {
+            rows.resize((candidate.size() + 1) * row_size);
+        }
+
+        bool pruned = false;
+        for (; depth < candidate.size(); ++depth) {
+            const int* const above = rows.data() + depth * row_size;
+            int* const row = rows.data() + (depth + 1) * row_size;
+            row[0] = static_cast<int>(depth + 1);
+            int row_min = row[0];
+            for (size_t i = 1; i < row_size; ++i) {
+                const int substitution = above[i - 1] + (word[i - 1] == candidate[depth] ? 0 : 1);
+                row[i] = std::min({above[i] + 1, row[i - 1] + 1, substitution});
+                row_min = std::min(row_min, row[i]);
+            }
+            if (row_min > max_distance) {
+                pruned = true;
+                break;
+            }
+        }
+
+        if (pruned) {
+            // Skip to the first word not starting with the dead prefix
+            std::string next_prefix(candidate.substr(0, depth + 1));
+            while (!next_prefix.empty() && next_prefix.back() == '\xff') {
+                next_prefix.pop_back();
+            }
+            if (next_prefix.empty()) {
+                break;
+            }
+            ++next_prefix.back();
+            previous = candidate;
+            valid_depth = depth + 1;
+            entry = dictionary_.lower_bound(std::string_view(next_prefix));
+            continue;
+        }
+
+        const int distance = rows[candidate.size() * row_size + word.size()];
+        if (distance <= max_distance) {
+            matches.emplace_back(distance, -static_cast<long long>(words_[entry->second].postings.size()), candidate);
+        }
+        // Rows 0..n hold the n characters of the word
+        previous = candidate;
+        valid_depth = candidate.size();
+        ++entry;
+    }
+
+    if (matches.size() > options_.max_pattern_expansions) {
+        std::nth_element(matches.begin(), matches.begin() + options_.max_pattern_expansions, matches.end());
+        matches.resize(options_.max_pattern_expansions);
+    }
+    std::sort(matches.begin(), matches.end());
+    for (const auto& [distance, document_count, match] : matches) {
+        words.emplace_back(match, distance);
+    }
+}
+
+void SearchServer::RemoveRepeatedExpansions(Query& query) {
+    std::pmr::set<std::string_view> seen(query.plus_words.begin(), query.plus_words.end(), query.plus_words.get_allocator().resource());
+    for (auto& expansions : query.pattern_expansions) {
+        const auto last = std::remove_if(expansions.begin(), expansions.end(), [&seen](const std::string_view word) {
+            return !seen.insert(word).second;
+        });
+        expansions.erase(last, expansions.end());
+    }
+    auto& fuzzy_words = query.fuzzy_words;
+    std::stable_sort(fuzzy_words.begin(), fuzzy_words.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second < rhs.second;
+    });
+    const auto last = std::remove_if(fuzzy_words.begin(), fuzzy_words.end(), [&seen](const auto& fuzzy_word) {
+        return !seen.insert(fuzzy_word.first).second;
+    });
+    fuzzy_words.erase(last, fuzzy_words.end());
+}
+
+std::optional<int> SearchServer::ParseFuzzySuffix(std::string_view& word) {
+    const size_t tilde = word.rfind('~');
+    if (tilde == word.npos) {
+        return std::nullopt;
+    }
+    const std::string_view suffix = word.substr(tilde + 1);
+    int distance = 1;
+    if (!suffix.empty()) {
+        const auto [end, error] = std::from_chars(suffix.data(), suffix.data() + suffix.size(), distance);
+        if (error != std::errc() || end != suffix.data() + suffix.size()) {
+            return std::nullopt;
+        }
+    }
+    if (tilde == 0 || distance < 0 || distance > MAX_FUZZY_DISTANCE) {
+        throw std::invalid_argument("Query word "s + std::string(word) + " is invalid"s);
+    }
+    word = word.substr(0, tilde);
+    return distance;
+}
+
+void SearchServer::MergePostings(const std::pmr::vector<std::string_view>& words, PostingList& merged, std::pmr::memory_resource* resource) const {
+    struct Posting {
+        int document_id;
+        double term_freq;
+        int document_length;
+    };
+
+    std::pmr::vector<Posting> postings(resource);
+    for (const std::string_view word : words) {
+        const PostingList& word_postings = FindWord(word)->postings;
+        for (size_t i = 0; i < word_postings.size(); ++i) {
+            postings.push_back({word_postings.DocumentIds()[i], word_postings.TermFreqs()[i], word_postings.DocumentLengths()[i]});
+        }
+    }
+    std::stable_sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+        return lhs.document_id < rhs.document_id;
+    });
+
+    for (size_t begin = 0; begin < postings.size();) {
+        double term_freq = 0.0;
+        size_t end = begin;
+        for (; end < postings.size() && postings[end].document_id == postings[begin].document_id; ++end) {
+            term_freq += postings[end].term_freq;
+        }
+        merged.Insert(postings[begin].document_id, term_freq, postings[begin].document_length);
+        begin = end;
+    }
+}
 
-    return {word, is_minus, IsStopWord(word)};
+std::optional<int> SearchServer::ParseProximityOperator(const std::string_view word) {
+    const std::string_view prefix = "NEAR/"sv;
+    if (word.substr(0, prefix.size()) != prefix) {
+        return std::nullopt;
+    }
+    const std::string_view digits = word.substr(prefix.size());
+    int distance = 0;
+    const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), distance);
+    if (digits.empty() || error != std::errc() || end != digits.data() + digits.size() || distance < 0) {
+        throw std::invalid_argument("Query word "s + std::string(word) + " is invalid"s);
+    }
+    return distance;
+}
+
+QueryCost SearchServer::GetQueryCost(const Query& query) const {
+    QueryCost cost;
+    const auto add_word = [this, &cost](const std::string_view word) {
+        ++cost.term_count;
+        if (const WordData* word_data = FindWord(word)) {
+            cost.posting_count += word_data->postings.size();
+        }
+    };
+    for (const std::string_view word : query.plus_words) {
+        add_word(word);
+    }
+    for (const auto& expansions : query.pattern_expansions) {
+        for (const std::string_view word : expansions) {
+            add_word(word);
+        }
+    }
+    for (const auto& [word, distance] : query.fuzzy_words) {
+        add_word(word);
+    }
+    for (const std::string_view word : query.minus_words) {
+        add_word(word);
+    }
+    return cost;
 }
 
-void SearchServer::DeleteCopy(std::vector<std::string_view>& result) const {
-    sort(result.begin(), result.end());
-    auto last = unique(result.begin(), result.end());
-    if (last == result.end()) {
+void SearchServer::LogQueryIfSlow(const std::string_view raw_query, const Query& query, SlowQueryLog::Clock::time_point start, size_t result_count) const {
+    const auto latency = SlowQueryLog::Clock::now() - start;
+    const auto reason = slow_query_log_->Classify(latency);
+    if (!reason) {
         return;
     }
-    result.erase(last, result.end());
+    const QueryCost cost = GetQueryCost(query);
+    slow_query_log_->Record({std::chrono::system_clock::now(), latency, *reason, std::string(raw_query),
+                             cost.term_count, cost.posting_count, result_count});
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+std::optional<std::pmr::vector<int>> SearchServer::FindCandidateDocuments(const Query& query, std::pmr::memory_resource* resource) const {
+    if (!query.IsRestricted()) {
+        return std::nullopt;
+    }
+
+    std::pmr::vector<const PostingList*> postings(resource);
+    const auto add_postings = [this, &postings](const std::string_view word) {
+        const WordData* word_data = FindWord(word);
+        postings.push_back(word_data ? &word_data->postings : nullptr);
+    };
+    for (const std::string_view word : query.required_words) {
+        add_postings(word);
+    }
+    for (const Phrase& phrase : query.phrases) {
+        for (const auto& [word, offset] : phrase.words) {
+            add_postings(word);
+        }
+    }
+    for (const Proximity& proximity : query.proximities) {
+        add_postings(proximity.lhs);
+        add_postings(proximity.rhs);
+    }
+
+    std::pmr::vector<int> candidates(resource);
+    if (std::find(postings.begin(), postings.end(), nullptr) != postings.end()) {
+        return candidates;
+    }
+    // Intersecting from the rarest word keeps every intermediate result small
+    std::sort(postings.begin(), postings.end(), [](const PostingList* lhs, const PostingList* rhs) {
+        return lhs->size() < rhs->size();
+    });
+    candidates.assign(postings.front()->DocumentIds(), postings.front()->DocumentIds() + postings.front()->size());
+    std::pmr::vector<int> intersection(resource);
+    for (auto list = postings.begin() + 1; list != postings.end() && !candidates.empty(); ++list) {
+        intersection.clear();
+        IntersectSorted(candidates.data(), candidates.data() + candidates.size(),
+                        (*list)->DocumentIds(), (*list)->DocumentIds() + (*list)->size(), [&intersection](int document_id) {
+                            intersection.push_back(document_id);
+                        });
+        candidates.swap(intersection);
+    }
+
+    if (query.HasPositionalConstraints()) {
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [this, &query, resource](int document_id) {
+            return !MatchesPositions(query, document_id, resource);
+        }), candidates.end());
+    }
+    return candidates;
+}
+
+bool SearchServer::MatchesRestrictions(const Query& query, int document_id, std::pmr::memory_resource* resource) const {
+    const bool has_required_words = std::all_of(query.required_words.begin(), query.required_words.end(), [this, document_id](const std::string_view word) {
+        const WordData* word_data = FindWord(word);
+        return word_data != nullptr && word_data->postings.Contains(document_id);
+    });
+    return has_required_words && (!query.HasPositionalConstraints() || MatchesPositions(query, document_id, resource));
+}
+
+bool SearchServer::MatchesPositions(const Query& query, int document_id, std::pmr::memory_resource* resource) const {
+    const DocumentData& document = documents_.at(document_id);
+
+    for (const Phrase& phrase : query.phrases) {
+        std::pmr::vector<std::pmr::vector<int>> positions(phrase.words.size(), resource);
+        for (size_t i = 0; i < phrase.words.size(); ++i) {
+            if (!DecodeWordPositions(document, phrase.words[i].first, positions[i])) {
+                return false;
+            }
+        }
+        // Candidate starts come from the first word; the other words are found by
+        // galloping, and as starts only grow, every search resumes where the last stopped
+        std::pmr::vector<const int*> cursors(resource);
+        for (const auto& word_positions : positions) {
+            cursors.push_back(word_positions.data());
+        }
+        bool found = false;
+        for (const int first_position : positions.front()) {
+            const int start = first_position - phrase.words.front().second;
+            found = true;
+            for (size_t i = 1; i < positions.size() && found; ++i) {
+                const int* const last = positions[i].data() + positions[i].size();
+                cursors[i] = GallopLowerBound(cursors[i], last, start + phrase.words[i].second);
+                if (cursors[i] == last) {
+                    return false;
+                }
+                found = *cursors[i] == start + phrase.words[i].second;
+            }
+            if (found) {
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+
+    std::pmr::vector<int> lhs_positions(resource);
+    std::pmr::vector<int> rhs_positions(resource);
+    for (const Proximity& proximity : query.proximities) {
+        if (!DecodeWordPositions(document, proximity.lhs, lhs_positions) || !DecodeWordPositions(document, proximity.rhs, rhs_positions)) {
+            return false;
+        }
+        // Merge walk: the closest pair is always between neighbours in the merged order
+        auto lhs = lhs_positions.begin();
+        auto rhs = rhs_positions.begin();
+        bool found = false;
+        while (lhs != lhs_positions.end() && rhs != rhs_positions.end() && !found) {
+            found = std::abs(*lhs - *rhs) <= proximity.distance;
+            if (*lhs < *rhs) {
+                ++lhs;
+            } else {
+                ++rhs;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
 }
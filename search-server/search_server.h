@@ -1,39 +1,265 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
 #include <cmath>
 #include <stdexcept>
 #include <utility>
 #include <vector>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <execution>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <numeric>
+#include <optional>
 #include <string_view>
-#include <deque>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <variant>
 
 #include "string_processing.h"
 #include "document.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "intersection.h"
+#include "posting_list.h"
+#include "query_trace.h"
+#include "varint.h"
+#include "word_hash.h"
+#include "query_arena.h"
+#include "scoring.h"
+#include "search_metrics.h"
+#include "slow_query_log.h"
+#include "stemming.h"
+#include "text_normalization.h"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
 
 const double EPSILON = 1e-6;
 
+// What AddDocument does with a document whose word set equals the one of a stored document
+enum class DuplicatePolicy {
+    ALLOW,
+    REJECT,
+    REPLACE,
+    REPORT,
+};
+
+struct SearchServerOptions {
+    // Keep the positions of words in documents, which phrase and NEAR queries need.
+    // Costs about one byte per word of indexed text.
+    bool store_positions = false;
+    // A query word with * or ? or a fuzzy word is replaced by at most this many
+    // of the dictionary words it matches, closest and most frequent first
+    size_t max_pattern_expansions = 64;
+    // A pattern examines at most this many dictionary words starting with its
+    // literal prefix and is expanded from those, so a pattern with a short or
+    // empty prefix, like *x, cannot scan a large dictionary per query word
+    size_t max_pattern_scan = 1 << 16;
+    // Score all expansions of a pattern as a single word whose postings are the
+    // union of theirs, instead of as separate query words
+    bool merge_pattern_expansions = false;
+    // Scores of a dictionary word matched by a fuzzy word are multiplied by
+    // this for every edit
+    double fuzzy_match_penalty = 0.5;
+    // Applied to document words, query words and stop words alike
+    NormalizationOptions normalization;
+    // Maps words that are not stop words to index terms, e.g. PorterStem. Query
+    // patterns and fuzzy words are matched against the terms without stemming.
+    Stemmer stemmer;
+    // How many stems of recent words are kept, so repeated words are stemmed once
+    size_t stem_cache_size = 1 << 16;
+    // Record the counters and stage latencies of search_metrics.h
+    bool collect_metrics = true;
+};
+
+// Options of a single FindTopDocuments call
+struct QueryOptions {
+    // Filled in with how the query was executed, if not null. Without it the
+    // query does not read the clock or keep any per-term statistics.
+    QueryTrace* trace = nullptr;
+    // If not 0, only the first postings of each query word, those of the
+    // documents with the lowest ids, are scored: a cheaper and less complete
+    // answer for overload. Minus words and relevance weights are unaffected.
+    size_t max_postings_per_term = 0;
+    // If not 0, a query whose posting lists are longer in total is refused
+    // with QueryCostExceededError after parsing, before anything is scored
+    size_t max_query_postings = 0;
+};
+
+// What a query scans, known from the index before it runs
+struct QueryCost {
+    // Query words, pattern expansions and minus words
+    size_t term_count = 0;
+    // Total length of their posting lists: what scoring scans without
+    // required words or positional constraints
+    size_t posting_count = 0;
+};
+
+class QueryCostExceededError : public std::runtime_error {
+public:
+    QueryCostExceededError(const QueryCost& cost, size_t max_query_postings)
+        : std::runtime_error("Query scans "s + std::to_string(cost.posting_count) + " postings, over the budget of "s
+                             + std::to_string(max_query_postings))
+        , cost_(cost) {
+    }
+
+    const QueryCost& GetCost() const {
+        return cost_;
+    }
+private:
+    QueryCost cost_;
+};
+
 class SearchServer {
 public:
+    using WordId = uint32_t;
+
+    // Forward index entry of a document: (word, term frequency) pairs ordered by
+    // internal word id. Invalidated by any modification of the server.
+    class WordFrequencies {
+    public:
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<std::string_view, double>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            Iterator(const SearchServer* server, const WordId* word_id, const double* freq)
+                : server_(server)
+                , word_id_(word_id)
+                , freq_(freq) {
+            }
+
+            value_type operator*() const {
+                return {server_->words_[*word_id_].text, *freq_};
+            }
+
+            Iterator& operator++() {
+                ++word_id_;
+                ++freq_;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator result = *this;
+                ++*this;
+                return result;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return word_id_ == other.word_id_;
+            }
+
+            bool operator!=(const Iterator& other) const {
+                return word_id_ != other.word_id_;
+            }
+
+        private:
+            const SearchServer* server_;
+            const WordId* word_id_;
+            const double* freq_;
+        };
+
+        WordFrequencies(const SearchServer* server, const WordId* word_ids, const double* freqs, size_t size)
+            : server_(server)
+            , word_ids_(word_ids)
+            , freqs_(freqs)
+            , size_(size) {
+        }
+
+        Iterator begin() const {
+            return {server_, word_ids_, freqs_};
+        }
+
+        Iterator end() const {
+            return {server_, word_ids_ + size_, freqs_ + size_};
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        const WordId* word_ids() const {
+            return word_ids_;
+        }
+
+    private:
+        const SearchServer* server_;
+        const WordId* word_ids_;
+        const double* freqs_;
+        size_t size_;
+    };
+
+    // Index containers allocate from index_resource; by default the server owns
+    // a pool with size-classed free lists, so nodes freed by RemoveDocument are reused
+    template <typename StringContainer>
+    explicit SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* index_resource = nullptr);
+
+    explicit SearchServer(const std::string& stop_words_text, std::pmr::memory_resource* index_resource = nullptr);
+
+    explicit SearchServer(const std::string_view stop_words_text, std::pmr::memory_resource* index_resource = nullptr);
+
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    SearchServer(const StringContainer& stop_words, const SearchServerOptions& options, std::pmr::memory_resource* index_resource = nullptr);
 
-    explicit SearchServer(const std::string& stop_words_text);
+    SearchServer(const std::string& stop_words_text, const SearchServerOptions& options, std::pmr::memory_resource* index_resource = nullptr);
 
-    explicit SearchServer(const std::string_view stop_words_text);
+    SearchServer(const std::string_view stop_words_text, const SearchServerOptions& options, std::pmr::memory_resource* index_resource = nullptr);
+
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+
+    SearchServer(SearchServer&&) = default;
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Query syntax: words are OR'ed, -word excludes documents, +word is required:
+    // only documents containing all required words are scored. With store_positions
+    // a document must also contain every "quoted phrase" and satisfy every
+    // lhs NEAR/k rhs, meaning the two words are at most k positions apart.
+    // Stop words count as positions. Words of phrases and NEAR also add relevance.
+    // A word with wildcards, as in cat* or c?t, matches dictionary words; it can
+    // be excluded with - but not required, quoted or used with NEAR. The same holds
+    // for fuzzy words: cat~ matches words within one edit of cat, cat~2 within two.
+
+    using DuplicateHandler = std::function<void(int document_id, int duplicate_of)>;
+
+    // With any policy but ALLOW the server keeps a fingerprint index, so AddDocument
+    // detects a duplicate at the cost of hashing the new document. The handler is
+    // called for every detected duplicate; REJECT then throws std::invalid_argument,
+    // REPLACE removes the stored document and REPORT keeps both.
+    void SetDuplicatePolicy(DuplicatePolicy policy, DuplicateHandler handler = {});
+
+    // Ranks with the given scorer instead of the server-wide one. The posting
+    // loop is compiled for the scorer type; an AnyScorer is dispatched once per query.
+    template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Scorer& scorer) const;
+
+    template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Scorer& scorer, const QueryOptions& query_options) const;
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const AnyScorer& scorer, const QueryOptions& query_options) const;
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const QueryOptions& query_options) const;
+
     template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate) const;
 
@@ -50,78 +276,310 @@ public:
 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
+    // Explain mode: FindTopDocuments(raw_query, QueryOptions{&trace})
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const QueryOptions& query_options) const;
+
+    // Parses the query and sums the posting lists it would scan
+    QueryCost EstimateQueryCost(const std::string_view raw_query) const;
+
+    // Scorer of the overloads that take none, TfIdfScorer by default
+    void SetScorer(const AnyScorer& scorer);
+
+    // Times every FindTopDocuments query and logs the slow and sampled ones,
+    // null to stop. Like SetScorer, not to be called while queries run.
+    void SetSlowQueryLog(std::shared_ptr<SlowQueryLog> slow_query_log);
+
+    // Up to max_count dictionary words starting with the prefix, most frequent first,
+    // chosen among the first max_pattern_scan of them
+    std::vector<std::string> FindWordsByPrefix(std::string_view prefix, size_t max_count) const;
+
     int GetDocumentCount() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    CorpusStats GetCorpusStats() const;
+
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    // Order-independent hash of the distinct words of the document, computed by
+    // AddDocument. Documents with equal word sets always have equal fingerprints.
+    uint64_t GetWordSetFingerprint(int document_id) const;
 
     void RemoveDocument(int document_id);
 
     template <typename Type>
     void RemoveDocument(Type exec, int document_id);
 
+    // Bulk removal: the removed (word, document) pairs are grouped by word and
+    // the posting maps are updated in parallel under a parallel policy
+    template <typename ExecutionPolicy>
+    void RemoveDocuments(const ExecutionPolicy& exec, const std::vector<int>& document_ids);
+
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Words are owned by the index only while some document contains them:
+    // RemoveDocument frees the postings and the dictionary entry of a word with
+    // its last document. Compact() additionally moves the whole index into fresh
+    // storage, returning the memory fragmented by removals.
+    void Compact();
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, const std::string_view raw_query, int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view raw_query, int document_id) const;
 
-    std::set<int>::iterator begin();
+    std::pmr::set<int>::iterator begin();
+
+    std::pmr::set<int>::iterator end();
+
+    std::pmr::set<int>::const_iterator begin() const;
 
-    std::set<int>::iterator end();
+    std::pmr::set<int>::const_iterator end() const;
 
-    const std::set<int>::iterator begin_const();
+    const std::pmr::set<int>::iterator begin_const();
 
-    const std::set<int>::iterator end_const();
+    const std::pmr::set<int>::iterator end_const();
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        uint64_t word_set_fingerprint;
+        // Slice of the forward index arrays
+        size_t words_offset;
+        size_t word_count;
+        // Number of indexed words, repeats included
+        int length;
+    };
+
+    struct WordData {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        explicit WordData(const allocator_type& allocator)
+            : postings(allocator) {
+        }
+
+        WordData(const WordData& other, const allocator_type& allocator)
+            : text(other.text)
+            , postings(other.postings, allocator) {
+        }
+
+        WordData(WordData&& other, const allocator_type& allocator)
+            : text(other.text)
+            , postings(std::move(other.postings), allocator) {
+        }
+
+        // Points to the key of the word in dictionary_, empty for a free slot
+        std::string_view text;
+        PostingList postings;
     };
 
-    std::deque<std::string> dictionary_;
+    using Dictionary = std::pmr::map<std::pmr::string, WordId, std::less<>>;
+
+    std::unique_ptr<std::pmr::synchronized_pool_resource> own_index_resource_;
+    std::pmr::memory_resource* index_resource_;
+    Dictionary dictionary_;
+    std::pmr::vector<WordData> words_;
+    std::pmr::vector<WordId> free_word_ids_;
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<int, DocumentData> documents_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::set<int> document_ids_;
+    const SearchServerOptions options_;
+    // Null without a stemmer
+    std::unique_ptr<StemCache> stem_cache_;
+    std::pmr::map<int, DocumentData> documents_;
+    // Forward index: the words of every document, sorted by id, stored back to back
+    std::pmr::vector<WordId> document_word_ids_;
+    std::pmr::vector<double> document_word_freqs_;
+    // With store_positions: the offset in position_bytes_ of every forward index
+    // entry, where its positions are stored as a varint count and varint gaps
+    std::pmr::vector<size_t> document_position_offsets_;
+    std::pmr::vector<unsigned char> position_bytes_;
+    size_t removed_word_entries_ = 0;
+    size_t total_document_length_ = 0;
+    std::pmr::set<int> document_ids_;
+    DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+    DuplicateHandler duplicate_handler_;
+    AnyScorer scorer_;
+    std::shared_ptr<SlowQueryLog> slow_query_log_;
+    std::pmr::unordered_map<uint64_t, std::pmr::vector<int>> fingerprint_to_document_ids_;
+
+    const WordData* FindWord(const std::string_view word) const;
+
+    WordId AddWord(const std::string_view word);
+
+    void ReclaimWordIfUnused(WordId word_id);
+
+    // Score shards of a query under a parallel policy
+    static constexpr int PARALLEL_SCORE_SHARD_COUNT = 16;
+
+    // Rewrites the forward index without the entries of removed documents
+    void CompactForwardIndex();
+
+    void AppendPositions(const std::vector<int>& positions);
+
+    // Size of the position list stored at the offset
+    size_t GetPositionListSize(size_t offset) const;
+
+    // False if the document does not contain the word
+    bool DecodeWordPositions(const DocumentData& document, const std::string_view word, std::pmr::vector<int>& positions) const;
+
+    // Id of a stored document with exactly these words, given sorted and distinct
+    std::optional<int> FindStoredDuplicate(uint64_t word_set_fingerprint, const std::vector<std::string_view>& distinct_words) const;
+
+    void IndexFingerprint(int document_id);
+
+    void ForgetFingerprint(int document_id);
 
     bool IsStopWord(const std::string_view word) const;
 
+    // The index term of a normalized word, which may be allocated from the resource.
+    // Counts the stem cache hits and misses in the trace, if any.
+    std::string_view Stem(const std::string_view word, std::pmr::memory_resource* resource, QueryTrace* trace = nullptr) const;
+
+    // Stop words are compared with normalized words
+    static std::set<std::string, std::less<>> NormalizeStopWords(const std::set<std::string, std::less<>>& stop_words,
+                                                                 const NormalizationOptions& options);
+
     static bool IsValidWord(const std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Returns the index terms of the words, which may be allocated from the resource. Fills
+    // positions, if given, with the index of every returned word among all words
+    // of the text.
+    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text, std::pmr::memory_resource* resource,
+                                                       std::vector<int>* positions = nullptr) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWord {
         std::string_view data;
         bool is_minus;
+        bool is_required;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(const std::string_view text) const;
+    // The normalized and stemmed word may be allocated from the resource. A word of
+    // punctuation only is returned empty and counts as a stop word.
+    QueryWord ParseQueryWord(const std::string_view text, std::pmr::memory_resource* resource, QueryTrace* trace = nullptr) const;
+
+    struct Phrase {
+        explicit Phrase(std::pmr::memory_resource* resource)
+            : words(resource) {
+        }
+
+        // Words and their offsets from the start of the phrase
+        std::pmr::vector<std::pair<std::string_view, int>> words;
+    };
+
+    struct Proximity {
+        std::string_view lhs;
+        std::string_view rhs;
+        int distance;
+    };
 
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        explicit Query(std::pmr::memory_resource* resource)
+            : plus_words(resource)
+            , minus_words(resource)
+            , required_words(resource)
+            , pattern_expansions(resource)
+            , fuzzy_words(resource)
+            , phrases(resource)
+            , proximities(resource) {
+        }
+
+        bool HasPositionalConstraints() const {
+            return !phrases.empty() || !proximities.empty();
+        }
+
+        bool IsRestricted() const {
+            return !required_words.empty() || HasPositionalConstraints();
+        }
+
+        std::pmr::vector<std::string_view> plus_words;
+        std::pmr::vector<std::string_view> minus_words;
+        // Plus words marked with +, a document must contain all of them
+        std::pmr::vector<std::string_view> required_words;
+        // Dictionary words matched by each wildcard plus word
+        std::pmr::vector<std::pmr::vector<std::string_view>> pattern_expansions;
+        // Dictionary words close to fuzzy plus words, with the edit distance
+        std::pmr::vector<std::pair<std::string_view, int>> fuzzy_words;
+        std::pmr::vector<Phrase> phrases;
+        std::pmr::vector<Proximity> proximities;
     };
 
-    void DeleteCopy(std::vector<std::string_view>& vec) const;
+    // Dictionary words starting with the prefix and matching the pattern, if not
+    // empty, as (document count, word) pairs: the max_count most frequent ones
+    // of the first max_pattern_scan words with the prefix
+    std::pmr::vector<std::pair<size_t, std::string_view>> FindMatchingWords(const std::string_view prefix, const std::string_view pattern,
+                                                                            size_t max_count, std::pmr::memory_resource* resource) const;
 
-    template <typename ExecutionPolicy>
-    Query ParseQuery(const std::string_view text, ExecutionPolicy exec) const; // ExecutionPolicy exec = std::execution::sequenced_policy (   ?)
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    void ExpandPattern(const std::string_view pattern, std::pmr::vector<std::string_view>& words) const;
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    // Dictionary words within max_distance edits of the word, appended with their distance
+    void ExpandFuzzyWord(const std::string_view word, int max_distance, std::pmr::vector<std::pair<std::string_view, int>>& words) const;
 
-    template <typename DocumentPredicate, typename ExecutionPolicy>
-    std::vector<Document> FindAllDocuments(const ExecutionPolicy& exec, const Query& query, DocumentPredicate document_predicate) const;
+    // A dictionary word matched by several query words is scored once: drops
+    // the pattern expansions that are plus words or expansions of an earlier
+    // pattern, and the fuzzy matches that are either, keeping the closest
+    // match of a word matched by several fuzzy words
+    static void RemoveRepeatedExpansions(Query& query);
+
+    // Edit distance of a word~ or word~N query word, which is then stripped of the suffix
+    static std::optional<int> ParseFuzzySuffix(std::string_view& word);
+
+    static constexpr int MAX_FUZZY_DISTANCE = 2;
+
+    // Union of the postings of the words, with the term frequencies of a document summed
+    void MergePostings(const std::pmr::vector<std::string_view>& words, PostingList& merged, std::pmr::memory_resource* resource) const;
+
+    // Distance of a NEAR/k operator, nullopt for other words
+    static std::optional<int> ParseProximityOperator(const std::string_view word);
+
+    // Sorted ids of the documents containing all required words and satisfying all
+    // phrases and NEAR operators of the query, nullopt if it has none of them
+    std::optional<std::pmr::vector<int>> FindCandidateDocuments(const Query& query, std::pmr::memory_resource* resource) const;
+
+
+    QueryCost GetQueryCost(const Query& query) const;
+
+    // Passes the query to the slow query log if it decides to log it
+    void LogQueryIfSlow(const std::string_view raw_query, const Query& query, SlowQueryLog::Clock::time_point start, size_t result_count) const;
+
+    // Whether the document contains the required words and satisfies the positional constraints
+    bool MatchesRestrictions(const Query& query, int document_id, std::pmr::memory_resource* resource) const;
+
+    bool MatchesPositions(const Query& query, int document_id, std::pmr::memory_resource* resource) const;
+
+    template <typename Container>
+    static void DeleteCopy(Container& words);
+
+    template <typename ExecutionPolicy>
+    Query ParseQuery(const std::string_view text, ExecutionPolicy exec, std::pmr::memory_resource* resource, QueryTrace* trace = nullptr) const; // ExecutionPolicy exec = std::execution::sequenced_policy (   ?)
+    template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+    std::pmr::vector<Document> FindAllDocuments(const ExecutionPolicy& exec, const Query& query, DocumentPredicate document_predicate,
+                                                const Scorer& scorer, std::pmr::memory_resource* resource, const QueryOptions& query_options) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+SearchServer::SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* index_resource)
+    : SearchServer(stop_words, SearchServerOptions{}, index_resource)
+{
+}
+
+template <typename StringContainer>
+SearchServer::SearchServer(const StringContainer& stop_words, const SearchServerOptions& options, std::pmr::memory_resource* index_resource)
+    : own_index_resource_(index_resource ? nullptr : std::make_unique<std::pmr::synchronized_pool_resource>())
+    , index_resource_(index_resource ? index_resource : own_index_resource_.get())
+    , dictionary_(index_resource_)
+    , words_(index_resource_)
+    , free_word_ids_(index_resource_)
+    , stop_words_(NormalizeStopWords(MakeUniqueNonEmptyStrings(stop_words), options.normalization))
+    , options_(options)
+    , stem_cache_(options.stemmer ? std::make_unique<StemCache>(options.stemmer, options.stem_cache_size) : nullptr)
+    , documents_(index_resource_)
+    , document_word_ids_(index_resource_)
+    , document_word_freqs_(index_resource_)
+    , document_position_offsets_(index_resource_)
+    , position_bytes_(index_resource_)
+    , document_ids_(index_resource_)
+    , fingerprint_to_document_ids_(index_resource_)
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid"s);
@@ -135,15 +593,55 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    std::vector<Document> matched_documents;
-        auto query = ParseQuery(raw_query, exec);
+    return FindTopDocuments(exec, raw_query, document_predicate, scorer_, QueryOptions{});
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     const QueryOptions& query_options) const {
+    return FindTopDocuments(exec, raw_query, document_predicate, scorer_, query_options);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     const Scorer& scorer) const {
+    return FindTopDocuments(exec, raw_query, document_predicate, scorer, QueryOptions{});
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     const Scorer& scorer, const QueryOptions& query_options) const {
+    QueryTrace* const trace = query_options.trace;
+    if (trace) {
+        *trace = QueryTrace{};
+    }
+    TraceTimer total_timer(trace);
+    TraceTimer trace_timer(trace);
+    const auto query_start = slow_query_log_ ? SlowQueryLog::Clock::now() : SlowQueryLog::Clock::time_point{};
+    QueryArena::Scope arena;
+    MetricsStopwatch stopwatch(options_.collect_metrics && ShouldSampleLatency());
+        auto query = ParseQuery(raw_query, exec, arena.Resource(), trace);
 
         if constexpr (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>) {
             DeleteCopy(query.minus_words);
             DeleteCopy(query.plus_words);
         }
+        stopwatch.Lap(MetricTimer::PARSE_QUERY);
+        if (trace) {
+            trace->parse_time = trace_timer.Lap();
+        }
+        if (query_options.max_query_postings != 0) {
+            const QueryCost cost = GetQueryCost(query);
+            if (cost.posting_count > query_options.max_query_postings) {
+                throw QueryCostExceededError(cost, query_options.max_query_postings);
+            }
+        }
 
-        matched_documents = FindAllDocuments(exec, query, document_predicate);
+        auto matched_documents = FindAllDocuments(exec, query, document_predicate, scorer, arena.Resource(), query_options);
+        stopwatch.Restart();
+        if (trace) {
+            trace_timer.Lap();
+        }
 
         sort(exec, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
             if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
@@ -156,7 +654,29 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec
         if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
             matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
         }
-    return matched_documents;
+        stopwatch.Lap(MetricTimer::TOP_K);
+    if (options_.collect_metrics) {
+        IncrementMetric(MetricCounter::QUERIES);
+        IncrementMetric(MetricCounter::DOCUMENTS_RETURNED, matched_documents.size());
+    }
+    if (trace) {
+        trace->sort_time = trace_timer.Lap();
+        trace->documents_returned = matched_documents.size();
+        trace->total_time = total_timer.Lap();
+    }
+    if (slow_query_log_) {
+        LogQueryIfSlow(raw_query, query, query_start, matched_documents.size());
+    }
+    // The only allocation of a query outside the arena: the result outlives it
+    return std::vector<Document>(matched_documents.begin(), matched_documents.end());
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec, const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     const AnyScorer& scorer, const QueryOptions& query_options) const {
+    return std::visit([&](const auto& concrete_scorer) {
+        return FindTopDocuments(exec, raw_query, document_predicate, concrete_scorer, query_options);
+    }, scorer);
 }
 
 template <typename ExecutionPolicy>
@@ -173,93 +693,460 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& exec
 
 template <typename Type>
 void SearchServer::RemoveDocument(Type exec, int document_id) {
-    if (documents_.count(document_id) == 0) {
-        return;
+    RemoveDocuments(exec, {document_id});
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocuments(const ExecutionPolicy& exec, const std::vector<int>& document_ids) {
+    struct RemovedDocument {
+        int id;
+        WordFrequencies words;
+        size_t offset;
+    };
+
+    std::vector<int> unique_ids(document_ids);
+    DeleteCopy(unique_ids);
+
+    std::vector<RemovedDocument> removed_documents;
+    size_t removal_count = 0;
+    for (const int document_id : unique_ids) {
+        if (documents_.count(document_id) == 0) {
+            continue;
+        }
+        removed_documents.push_back({document_id, GetWordFrequencies(document_id), removal_count});
+        removal_count += removed_documents.back().words.size();
     }
-    
-    std::vector<const std::string*> words_to_delete;
-    words_to_delete.reserve(document_to_word_freqs_.at(document_id).size());
-
-    std::for_each(exec,
-        document_to_word_freqs_.at(document_id).begin(),
-        document_to_word_freqs_.at(document_id).end(),
-        [&words_to_delete](const auto& elements) {
-            words_to_delete.push_back(&elements.first); });
-
-    std::for_each(exec,
-        words_to_delete.begin(), words_to_delete.end(),
-        [this, document_id](const std::string* word) {
-            word_to_document_freqs_.at(*word).erase(document_id);
-        });
 
-    document_to_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-}
+    // Group the (word, document) pairs by word, so every posting map is then
+    // modified by exactly one task and words_ itself is only read in parallel
+    std::vector<std::pair<WordId, int>> removals(removal_count);
+    std::for_each(exec, removed_documents.begin(), removed_documents.end(), [&removals](const RemovedDocument& document) {
+        auto removal = removals.begin() + document.offset;
+        for (size_t i = 0; i < document.words.size(); ++i) {
+            *removal++ = {document.words.word_ids()[i], document.id};
+        }
+    });
+    std::sort(exec, removals.begin(), removals.end());
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
+    std::vector<std::pair<size_t, size_t>> word_ranges;
+    for (size_t begin = 0; begin < removals.size();) {
+        size_t end = begin + 1;
+        while (end < removals.size() && removals[end].first == removals[begin].first) {
+            ++end;
+        }
+        word_ranges.emplace_back(begin, end);
+        begin = end;
+    }
+
+    std::vector<int> removed_ids(removals.size());
+    std::transform(exec, removals.begin(), removals.end(), removed_ids.begin(), [](const std::pair<WordId, int>& removal) {
+        return removal.second;
+    });
+    std::for_each(exec, word_ranges.begin(), word_ranges.end(), [this, &removals, &removed_ids](const std::pair<size_t, size_t>& range) {
+        auto& postings = words_[removals[range.first].first].postings;
+        if (postings.size() == range.second - range.first) {
+            postings.Clear();
+        } else {
+            postings.Erase(removed_ids.data() + range.first, removed_ids.data() + range.second);
+        }
+    });
+
+    for (const auto& [begin, end] : word_ranges) {
+        ReclaimWordIfUnused(removals[begin].first);
+    }
+
+    for (const RemovedDocument& document : removed_documents) {
+        removed_word_entries_ += document.words.size();
+        total_document_length_ -= documents_.at(document.id).length;
+        ForgetFingerprint(document.id);
+        documents_.erase(document.id);
+        document_ids_.erase(document.id);
+    }
+    if (removed_word_entries_ > document_word_ids_.size() / 2) {
+        CompactForwardIndex();
+    }
 }
 
-template <typename DocumentPredicate, typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& exec, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(500);
-
-    std::for_each(exec, query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance, &document_predicate](const auto& word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-            }
-        });
+template <typename DocumentPredicate, typename ExecutionPolicy, typename Scorer>
+std::pmr::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& exec, const Query& query, DocumentPredicate document_predicate,
+                                                          const Scorer& scorer, std::pmr::memory_resource* resource, const QueryOptions& query_options) const {
+    struct ScoredPostings {
+        const PostingList* postings;
+        double term_weight;
+        // Postings scored, all unless capped by max_postings_per_term
+        size_t limit;
+    };
 
-    auto result = document_to_relevance.BuildOrdinaryMap();
+    QueryTrace* const trace = query_options.trace;
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    const CorpusStats corpus = GetCorpusStats();
+    std::pmr::vector<ScoredPostings> plus_postings(resource);
+    // Index of the trace term of every entry of plus_postings
+    std::pmr::vector<size_t> traced_terms(resource);
+    size_t posting_count = 0;
+    const auto add_plus_postings = [&](const PostingList& postings, std::string_view word) {
+        const size_t limit = query_options.max_postings_per_term
+            ? std::min(postings.size(), query_options.max_postings_per_term) : postings.size();
+        plus_postings.push_back({&postings, scorer.ComputeTermWeight(corpus, static_cast<int>(postings.size())), limit});
+        posting_count += limit;
+        if (trace) {
+            traced_terms.push_back(trace->terms.size());
+            trace->terms.push_back({std::string(word), false, plus_postings.back().term_weight, postings.size()});
+        }
+    };
+    for (const std::string_view word : query.plus_words) {
+        if (const WordData* word_data = FindWord(word)) {
+            add_plus_postings(word_data->postings, word_data->text);
+        } else if (trace) {
+            trace->terms.push_back({std::string(word)});
+        }
+    }
+    std::pmr::vector<PostingList> merged_postings(resource);
+    merged_postings.reserve(query.pattern_expansions.size());
+    for (const auto& expansions : query.pattern_expansions) {
+        if (expansions.empty()) {
+            continue;
+        }
+        if (options_.merge_pattern_expansions) {
+            PostingList& merged = merged_postings.emplace_back();
+            MergePostings(expansions, merged, resource);
+            std::string merged_words;
+            if (trace) {
+                for (const std::string_view word : expansions) {
+                    merged_words += (merged_words.empty() ? ""s : "|"s) + std::string(word);
+                }
+            }
+            add_plus_postings(merged, merged_words);
             continue;
         }
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            result.erase(document_id);
+        for (const std::string_view word : expansions) {
+            add_plus_postings(FindWord(word)->postings, word);
+        }
+    }
+    for (const auto& [word, distance] : query.fuzzy_words) {
+        add_plus_postings(FindWord(word)->postings, word);
+        plus_postings.back().term_weight *= std::pow(options_.fuzzy_match_penalty, distance);
+        if (trace) {
+            trace->terms.back().weight = plus_postings.back().term_weight;
+        }
+    }
+    std::pmr::vector<const PostingList*> minus_postings(resource);
+    for (const std::string_view word : query.minus_words) {
+        const WordData* word_data = FindWord(word);
+        if (word_data) {
+            minus_postings.push_back(&word_data->postings);
         }
+        if (trace) {
+            // Every shard scans its part of the postings of a minus word
+            const size_t document_frequency = word_data ? word_data->postings.size() : 0;
+            trace->terms.push_back({std::string(word), true, 0.0, document_frequency, document_frequency});
+        }
+    }
+    if (plus_postings.empty()) {
+        return std::pmr::vector<Document>(resource);
+    }
+    // With required words or positional constraints only the documents
+    // satisfying them are scored
+    TraceTimer trace_timer(trace);
+    const auto candidates = FindCandidateDocuments(query, resource);
+    if (trace && candidates) {
+        trace->candidate_time = trace_timer.Lap();
+        trace->candidate_count = candidates->size();
+    }
+    if (candidates && candidates->empty()) {
+        return std::pmr::vector<Document>(resource);
     }
 
-    std::vector<Document> matched_documents(result.size());
+    // The id range of the documents is split into shards that never share an
+    // accumulator, so under a parallel policy they are scored without locks.
+    // Postings are sorted by id, so a shard finds its part of each by binary search.
+    const long long first_id = documents_.begin()->first;
+    const long long id_range = documents_.rbegin()->first - first_id + 1;
+    const int shard_count = std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>
+        ? 1 : static_cast<int>(std::min<long long>(PARALLEL_SCORE_SHARD_COUNT, id_range));
 
+    // Worker threads of a parallel policy allocate concurrently
+    SynchronizedResource shared_resource(resource);
+    std::pmr::memory_resource* const shard_resource = shard_count == 1 ? resource : &shared_resource;
+    std::pmr::vector<std::pmr::vector<Document>> shard_documents(shard_count, shard_resource);
+    std::pmr::vector<int> shards(shard_count, resource);
+    std::iota(shards.begin(), shards.end(), 0);
 
-    std::transform(exec, result.begin(), result.end(), matched_documents.begin(),
-        [this](auto& element) {
-            return Document{ element.first, element.second, documents_.at(element.first).rating};
+    // Every shard traces into its own slots, which are summed afterwards
+    std::pmr::vector<QueryTrace> shard_traces(trace ? shard_count : 0, resource);
+    for (QueryTrace& shard_trace : shard_traces) {
+        shard_trace.terms.resize(plus_postings.size());
+    }
+
+    std::for_each(exec, shards.begin(), shards.end(), [&](int shard) {
+        const int shard_first_id = static_cast<int>(first_id + id_range * shard / shard_count);
+        const int shard_last_id = static_cast<int>(first_id + id_range * (shard + 1) / shard_count - 1);
+        const auto shard_part = [shard_first_id, shard_last_id](const PostingList& postings) {
+            return std::pair{postings.LowerBound(shard_first_id), postings.UpperBound(shard_last_id)};
+        };
+
+        const int* shard_candidates = nullptr;
+        const int* shard_candidates_end = nullptr;
+        if (candidates) {
+            shard_candidates = std::lower_bound(candidates->data(), candidates->data() + candidates->size(), shard_first_id);
+            shard_candidates_end = std::upper_bound(shard_candidates, candidates->data() + candidates->size(), shard_last_id);
+        }
+        const size_t expected_postings = candidates ? (shard_candidates_end - shard_candidates) * plus_postings.size() : posting_count / shard_count;
+
+        MetricsStopwatch stopwatch(options_.collect_metrics && ShouldSampleLatency());
+        QueryTrace* const shard_trace = trace ? &shard_traces[shard] : nullptr;
+        TraceTimer shard_timer(shard_trace);
+        size_t scanned_postings = 0;
+        ScoreAccumulator accumulator(shard_first_id, shard_last_id, expected_postings, shard_resource);
+        double scores[SCORE_BLOCK_SIZE];
+        int block_ids[SCORE_BLOCK_SIZE];
+        double block_freqs[SCORE_BLOCK_SIZE];
+        int block_lengths[SCORE_BLOCK_SIZE];
+        for (size_t term = 0; term < plus_postings.size(); ++term) {
+            const auto& [postings, term_weight, limit] = plus_postings[term];
+            const size_t term_start_postings = scanned_postings;
+            auto [begin, end] = shard_part(*postings);
+            end = std::min(end, limit);
+            begin = std::min(begin, end);
+            if (!candidates) {
+                scanned_postings += end - begin;
+                for (size_t block = begin; block < end; block += SCORE_BLOCK_SIZE) {
+                    const size_t block_size = std::min(SCORE_BLOCK_SIZE, end - block);
+                    scorer.ComputeScores(corpus, term_weight, postings->TermFreqs() + block, postings->DocumentLengths() + block,
+                                         scores, block_size);
+                    accumulator.Add(postings->DocumentIds() + block, scores, block_size);
+                }
+            } else {
+                // The candidates are looked up in the posting list by galloping and
+                // their postings are gathered into blocks for the kernel
+                const int* const ids = postings->DocumentIds();
+                const int* const ids_end = ids + end;
+                const int* cursor = ids + begin;
+                size_t block_size = 0;
+                for (const int* candidate = shard_candidates; candidate != shard_candidates_end; ++candidate) {
+                    cursor = GallopLowerBound(cursor, ids_end, *candidate);
+                    ++scanned_postings;
+                    if (cursor == ids_end) {
+                        break;
+                    }
+                    if (*cursor != *candidate) {
+                        continue;
+                    }
+                    block_ids[block_size] = *cursor;
+                    block_freqs[block_size] = postings->TermFreqs()[cursor - ids];
+                    block_lengths[block_size] = postings->DocumentLengths()[cursor - ids];
+                    if (++block_size == SCORE_BLOCK_SIZE) {
+                        scorer.ComputeScores(corpus, term_weight, block_freqs, block_lengths, scores, block_size);
+                        accumulator.Add(block_ids, scores, block_size);
+                        block_size = 0;
+                    }
+                }
+                scorer.ComputeScores(corpus, term_weight, block_freqs, block_lengths, scores, block_size);
+                accumulator.Add(block_ids, scores, block_size);
+            }
+            if (shard_trace) {
+                QueryTrace::Term& traced_term = shard_trace->terms[term];
+                traced_term.postings_visited = scanned_postings - term_start_postings;
+                traced_term.scan_time = shard_timer.Lap();
+                shard_trace->scan_time += traced_term.scan_time;
+            }
+        }
+        for (const PostingList* postings : minus_postings) {
+            const auto [begin, end] = shard_part(*postings);
+            scanned_postings += end - begin;
+            for (size_t i = begin; i < end; ++i) {
+                accumulator.Exclude(postings->DocumentIds()[i]);
+            }
+        }
+        stopwatch.Lap(MetricTimer::POSTING_SCAN);
+        if (shard_trace) {
+            shard_trace->minus_time = shard_timer.Lap();
+        }
+
+        // The predicate is checked once per matched document, not per posting
+        auto& matched_documents = shard_documents[shard];
+        size_t scored_documents = 0;
+        accumulator.ForEach([&](int document_id, double relevance) {
+            ++scored_documents;
+            const auto& document_data = documents_.at(document_id);
+            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                matched_documents.push_back(Document{document_id, relevance, document_data.rating});
+            }
         });
+        stopwatch.Lap(MetricTimer::ACCUMULATION);
+        if (options_.collect_metrics) {
+            IncrementMetric(MetricCounter::POSTINGS_SCANNED, scanned_postings);
+            IncrementMetric(MetricCounter::DOCUMENTS_MATCHED, matched_documents.size());
+        }
+        if (shard_trace) {
+            shard_trace->collect_time = shard_timer.Lap();
+            shard_trace->accumulator_slots = accumulator.GetSlotCount();
+            shard_trace->dense_accumulators = accumulator.IsDense() ? 1 : 0;
+            shard_trace->documents_scored = scored_documents;
+            shard_trace->documents_matched = matched_documents.size();
+        }
+    });
+
+    if (trace) {
+        trace->shard_count = shard_count;
+        for (const QueryTrace& shard_trace : shard_traces) {
+            for (size_t term = 0; term < plus_postings.size(); ++term) {
+                QueryTrace::Term& traced_term = trace->terms[traced_terms[term]];
+                traced_term.postings_visited += shard_trace.terms[term].postings_visited;
+                traced_term.scan_time += shard_trace.terms[term].scan_time;
+            }
+            trace->scan_time += shard_trace.scan_time;
+            trace->minus_time += shard_trace.minus_time;
+            trace->collect_time += shard_trace.collect_time;
+            trace->accumulator_slots += shard_trace.accumulator_slots;
+            trace->dense_accumulators += shard_trace.dense_accumulators;
+            trace->documents_scored += shard_trace.documents_scored;
+            trace->documents_matched += shard_trace.documents_matched;
+        }
+    }
 
+    if (shard_count == 1) {
+        return std::pmr::vector<Document>(shard_documents.front(), resource);
+    }
+    std::pmr::vector<Document> matched_documents(resource);
+    for (const auto& documents : shard_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
     return matched_documents;
 }
 
 template <typename ExecutionPolicy>
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text, ExecutionPolicy exec) const {
-    Query result;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
+SearchServer::Query SearchServer::ParseQuery(const std::string_view text, ExecutionPolicy exec, std::pmr::memory_resource* resource, QueryTrace* trace) const {
+    Query result(resource);
+    bool in_phrase = false;
+    int phrase_offset = 0;
+    // The preceding token, if it is a plus word, and the distance of a NEAR/k after it
+    std::string_view previous_plus_word;
+    bool has_proximity = false;
+    int proximity_distance = 0;
+
+    for (std::string_view word : SplitIntoWords(text, resource)) {
+        if (!in_phrase && word[0] == '"') {
+            in_phrase = true;
+            phrase_offset = 0;
+            result.phrases.emplace_back(resource);
+            word.remove_prefix(1);
+        }
+        if (in_phrase) {
+            const bool closes_phrase = !word.empty() && word.back() == '"';
+            if (closes_phrase) {
+                word.remove_suffix(1);
+            }
+            if (!word.empty()) {
+                const auto query_word = ParseQueryWord(word, resource, trace);
+                std::string_view unsuffixed = query_word.data;
+                if (query_word.is_minus || IsWildcardPattern(query_word.data) || ParseFuzzySuffix(unsuffixed)) {
+                    throw std::invalid_argument("Phrase word "s + std::string(word) + " is invalid"s);
+                }
+                if (!query_word.is_stop) {
+                    result.phrases.back().words.emplace_back(query_word.data, phrase_offset);
+                    result.plus_words.push_back(query_word.data);
+                }
+                // Punctuation does not take a position in documents either
+                if (!query_word.data.empty()) {
+                    ++phrase_offset;
+                }
+            }
+            if (closes_phrase) {
+                in_phrase = false;
+                if (result.phrases.back().words.empty()) {
+                    result.phrases.pop_back();
+                }
+            }
+            previous_plus_word = {};
+            continue;
+        }
+
+        if (const auto distance = ParseProximityOperator(word)) {
+            if (previous_plus_word.empty()) {
+                throw std::invalid_argument("NEAR operator needs a word on both sides"s);
+            }
+            has_proximity = true;
+            proximity_distance = *distance;
+            continue;
+        }
+
+        auto query_word = ParseQueryWord(word, resource, trace);
+        if (const auto distance = ParseFuzzySuffix(query_word.data)) {
+            if (query_word.is_required || has_proximity) {
+                throw std::invalid_argument("Fuzzy word "s + std::string(word) + " can be neither required nor used with NEAR"s);
+            }
+            if (query_word.is_minus) {
+                std::pmr::vector<std::pair<std::string_view, int>> expansions(resource);
+                ExpandFuzzyWord(query_word.data, *distance, expansions);
+                for (const auto& [expansion, expansion_distance] : expansions) {
+                    result.minus_words.push_back(expansion);
+                }
+            } else {
+                ExpandFuzzyWord(query_word.data, *distance, result.fuzzy_words);
+            }
+            previous_plus_word = {};
+            continue;
+        }
+        if (IsWildcardPattern(query_word.data)) {
+            if (query_word.is_required || has_proximity) {
+                throw std::invalid_argument("Pattern "s + std::string(word) + " can be neither required nor used with NEAR"s);
+            }
+            if (query_word.is_minus) {
+                ExpandPattern(query_word.data, result.minus_words);
+            } else {
+                ExpandPattern(query_word.data, result.pattern_expansions.emplace_back());
+            }
+            previous_plus_word = {};
+            continue;
+        }
+        if (has_proximity) {
+            if (query_word.is_minus || query_word.is_stop) {
+                throw std::invalid_argument("NEAR operator needs a word on both sides"s);
+            }
+            result.proximities.push_back({previous_plus_word, query_word.data, proximity_distance});
+            has_proximity = false;
+        }
+        previous_plus_word = {};
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 result.minus_words.push_back(query_word.data);
             }
             else {
                 result.plus_words.push_back(query_word.data);
+                if (query_word.is_required) {
+                    result.required_words.push_back(query_word.data);
+                }
+                previous_plus_word = query_word.data;
             }
         }
     }
+    if (in_phrase) {
+        throw std::invalid_argument("Phrase is not closed"s);
+    }
+    if (has_proximity) {
+        throw std::invalid_argument("NEAR operator needs a word on both sides"s);
+    }
+    if (result.HasPositionalConstraints() && !options_.store_positions) {
+        throw std::invalid_argument("Phrase and NEAR queries need a server with store_positions"s);
+    }
+    RemoveRepeatedExpansions(result);
+
     if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
         DeleteCopy(result.minus_words);
         DeleteCopy(result.plus_words);
+        DeleteCopy(result.required_words);
     }
     return result;
 
 }
+
+template <typename Container>
+void SearchServer::DeleteCopy(Container& words) {
+    sort(words.begin(), words.end());
+    auto last = unique(words.begin(), words.end());
+    if (last == words.end()) {
+        return;
+    }
+    words.erase(last, words.end());
+}
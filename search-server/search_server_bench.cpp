@@ -0,0 +1,256 @@
+// Microbenchmarks over synthetic Zipf corpora of growing size.
+//
+//     search_server_bench [--max_documents=N] [benchmark flags]
+//
+// Corpora of 10k, 100k, 1M and 10M documents are built up to max_documents,
+// 1M by default. Every corpus is built once, and all its benchmarks run before
+// the next one is built. The seeds are fixed, so runs are comparable. Add
+// --benchmark_out=results.json --benchmark_out_format=json to save the results,
+// and build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "concurrent_map.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "synthetic_corpus.h"
+
+using namespace std;
+
+namespace {
+
+const size_t QUERY_COUNT = 1000;
+const size_t QUERY_WORD_COUNT = 3;
+const double MINUS_WORD_RATIO = 0.1;
+// Documents kept aside to add to or to swap into the index
+const size_t SPARE_DOCUMENT_COUNT = 4096;
+// RemoveDuplicates rebuilds its server on every iteration, so it is capped
+const size_t MAX_DUPLICATES_CORPUS_SIZE = 100'000;
+
+const SyntheticCorpus& GetCorpus() {
+    static const SyntheticCorpus corpus(SyntheticCorpusOptions{});
+    return corpus;
+}
+
+struct Workload {
+    explicit Workload(size_t document_count)
+        : document_count(document_count)
+        , search_server(""s) {
+        const SyntheticCorpus& corpus = GetCorpus();
+        auto document_random = corpus.MakeRandom(1);
+        for (size_t id = 0; id < document_count; ++id) {
+            search_server.AddDocument(static_cast<int>(id), corpus.MakeDocument(document_random), DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        auto query_random = corpus.MakeRandom(2);
+        for (size_t i = 0; i < QUERY_COUNT; ++i) {
+            queries.push_back(corpus.MakeQuery(query_random, QUERY_WORD_COUNT, MINUS_WORD_RATIO));
+        }
+        auto spare_random = corpus.MakeRandom(3);
+        for (size_t i = 0; i < SPARE_DOCUMENT_COUNT; ++i) {
+            spare_documents.push_back(corpus.MakeDocument(spare_random));
+        }
+    }
+
+    size_t document_count;
+    SearchServer search_server;
+    vector<string> queries;
+    vector<string> spare_documents;
+};
+
+// Only the corpus of the running benchmarks is kept in memory
+Workload& GetWorkload(size_t document_count) {
+    static unique_ptr<Workload> workload;
+    if (!workload || workload->document_count != document_count) {
+        workload.reset();
+        workload = make_unique<Workload>(document_count);
+    }
+    return *workload;
+}
+
+void BM_SplitIntoWords(benchmark::State& state) {
+    const SyntheticCorpus& corpus = GetCorpus();
+    auto random = corpus.MakeRandom(4);
+    vector<string> documents;
+    size_t bytes = 0;
+    for (size_t i = 0; i < SPARE_DOCUMENT_COUNT; ++i) {
+        documents.push_back(corpus.MakeDocument(random));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& document = documents[i++ % documents.size()];
+        benchmark::DoNotOptimize(SplitIntoWords(document));
+        bytes += document.size();
+    }
+    state.SetBytesProcessed(bytes);
+}
+
+// ParseQuery is private, so it is measured through queries to an empty index,
+// where looking the words up costs next to nothing
+void BM_ParseQuery(benchmark::State& state) {
+    const SyntheticCorpus& corpus = GetCorpus();
+    auto random = corpus.MakeRandom(2);
+    vector<string> queries;
+    for (size_t i = 0; i < QUERY_COUNT; ++i) {
+        queries.push_back(corpus.MakeQuery(random, QUERY_WORD_COUNT, MINUS_WORD_RATIO));
+    }
+    const SearchServer search_server("and in on the"s);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(queries[i++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ConcurrentMap(benchmark::State& state) {
+    static ConcurrentMap<int, int> map(64);
+    std::mt19937_64 random(state.thread_index());
+    for (auto _ : state) {
+        ++map[static_cast<int>(random() % 100'000)].ref_to_value;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_AddDocument(benchmark::State& state, size_t document_count) {
+    Workload& workload = GetWorkload(document_count);
+    vector<int> added;
+    int id = static_cast<int>(workload.document_count);
+    for (auto _ : state) {
+        workload.search_server.AddDocument(id, workload.spare_documents[added.size() % SPARE_DOCUMENT_COUNT], DocumentStatus::ACTUAL, {1});
+        added.push_back(id++);
+    }
+    state.SetItemsProcessed(state.iterations());
+    workload.search_server.RemoveDocuments(std::execution::par, added);
+}
+
+template <typename ExecutionPolicy>
+void BM_FindTopDocuments(benchmark::State& state, ExecutionPolicy policy, size_t document_count) {
+    const Workload& workload = GetWorkload(document_count);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(workload.search_server.FindTopDocuments(policy, workload.queries[i++ % QUERY_COUNT]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename ExecutionPolicy>
+void BM_MatchDocument(benchmark::State& state, ExecutionPolicy policy, size_t document_count) {
+    const Workload& workload = GetWorkload(document_count);
+    std::mt19937_64 random(5);
+    size_t i = 0;
+    for (auto _ : state) {
+        const int document_id = static_cast<int>(random() % workload.document_count);
+        benchmark::DoNotOptimize(workload.search_server.MatchDocument(policy, workload.queries[i++ % QUERY_COUNT], document_id));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Every removed document is put back with other text while the timer is paused
+void BM_RemoveDocument(benchmark::State& state, size_t document_count) {
+    Workload& workload = GetWorkload(document_count);
+    std::mt19937_64 random(6);
+    size_t i = 0;
+    for (auto _ : state) {
+        const int document_id = static_cast<int>(random() % workload.document_count);
+        workload.search_server.RemoveDocument(document_id);
+        state.PauseTiming();
+        workload.search_server.AddDocument(document_id, workload.spare_documents[i++ % SPARE_DOCUMENT_COUNT], DocumentStatus::ACTUAL, {1});
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A tenth of the documents repeat an earlier one
+void BM_RemoveDuplicates(benchmark::State& state, size_t document_count) {
+    const SyntheticCorpus& corpus = GetCorpus();
+    const size_t size = std::min(document_count, MAX_DUPLICATES_CORPUS_SIZE);
+    // RemoveDuplicates reports every duplicate to cout
+    std::ostringstream sink;
+    auto* const cout_buffer = cout.rdbuf(sink.rdbuf());
+    for (auto _ : state) {
+        state.PauseTiming();
+        SearchServer search_server(""s);
+        auto random = corpus.MakeRandom(7);
+        vector<string> documents;
+        for (size_t id = 0; id < size; ++id) {
+            documents.push_back(id % 10 == 9 ? documents[random() % documents.size()] : corpus.MakeDocument(random));
+            search_server.AddDocument(static_cast<int>(id), documents.back(), DocumentStatus::ACTUAL, {1});
+        }
+        sink.str({});
+        state.ResumeTiming();
+        RemoveDuplicates(search_server);
+    }
+    cout.rdbuf(cout_buffer);
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+void BM_ProcessQueries(benchmark::State& state, size_t document_count) {
+    const Workload& workload = GetWorkload(document_count);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProcessQueries(workload.search_server, workload.queries));
+    }
+    state.SetItemsProcessed(state.iterations() * QUERY_COUNT);
+}
+
+// Removes --max_documents=N from the arguments
+size_t ParseMaxDocuments(int& argc, char** argv) {
+    const string flag = "--max_documents="s;
+    size_t max_documents = 1'000'000;
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        const string argument = argv[i];
+        if (argument.compare(0, flag.size(), flag) == 0) {
+            max_documents = std::stoull(argument.substr(flag.size()));
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    return max_documents;
+}
+
+void RegisterBenchmarks(size_t max_documents) {
+    benchmark::RegisterBenchmark("SplitIntoWords", BM_SplitIntoWords);
+    benchmark::RegisterBenchmark("ParseQuery", BM_ParseQuery);
+    benchmark::RegisterBenchmark("ConcurrentMap", BM_ConcurrentMap)->ThreadRange(1, 8)->UseRealTime();
+
+    // Grouped by corpus size, as they run in the order of registration
+    for (size_t document_count = 10'000; document_count <= max_documents && document_count <= 10'000'000; document_count *= 10) {
+        const string suffix = "/"s + to_string(document_count);
+        benchmark::RegisterBenchmark(("AddDocument"s + suffix).c_str(), BM_AddDocument, document_count);
+        benchmark::RegisterBenchmark(("FindTopDocuments/seq"s + suffix).c_str(),
+                                     BM_FindTopDocuments<std::execution::sequenced_policy>, std::execution::seq, document_count);
+        benchmark::RegisterBenchmark(("FindTopDocuments/par"s + suffix).c_str(),
+                                     BM_FindTopDocuments<std::execution::parallel_policy>, std::execution::par, document_count)->UseRealTime();
+        benchmark::RegisterBenchmark(("MatchDocument/seq"s + suffix).c_str(),
+                                     BM_MatchDocument<std::execution::sequenced_policy>, std::execution::seq, document_count);
+        benchmark::RegisterBenchmark(("MatchDocument/par"s + suffix).c_str(),
+                                     BM_MatchDocument<std::execution::parallel_policy>, std::execution::par, document_count)->UseRealTime();
+        benchmark::RegisterBenchmark(("RemoveDocument"s + suffix).c_str(), BM_RemoveDocument, document_count);
+        benchmark::RegisterBenchmark(("ProcessQueries"s + suffix).c_str(), BM_ProcessQueries, document_count)->UseRealTime();
+        benchmark::RegisterBenchmark(("RemoveDuplicates"s + suffix).c_str(), BM_RemoveDuplicates, document_count)
+            ->Iterations(3)->Unit(benchmark::kMillisecond);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const size_t max_documents = ParseMaxDocuments(argc, argv);
+    RegisterBenchmarks(max_documents);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "document_loader.h"
+#include "index_server.h"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+IndexServer* running_server = nullptr;
+
+void HandleStopSignal(int) {
+    if (running_server != nullptr) {
+        running_server->Stop();
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        cerr << "Usage: "s << argv[0] << " <socket_path> <documents_file> [stop_words]"s << endl;
+        return 1;
+    }
+
+    try {
+        SearchServer search_server(argc == 4 ? string(argv[3]) : string());
+        {
+            LOG_DURATION("Loading documents"s);
+            cerr << "Loaded "s << LoadDocuments(search_server, argv[2]) << " documents"s << endl;
+        }
+
+        IndexServer index_server(search_server, argv[1]);
+        running_server = &index_server;
+        signal(SIGINT, HandleStopSignal);
+        signal(SIGTERM, HandleStopSignal);
+
+        cerr << "Listening on "s << argv[1] << endl;
+        index_server.Run();
+        running_server = nullptr;
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
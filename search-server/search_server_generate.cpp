@@ -0,0 +1,192 @@
+// Writes a synthetic corpus in the documents file format of document_loader.h
+// and a query log with one query per line, for the benchmarks, the daemon and
+// the load tester to replay.
+//
+//     search_server_generate --documents_out=docs.tsv --queries_out=queries.txt [--name=value...]
+//
+// Run with --help for the list of options. Both files are streamed, so their
+// size is not limited by memory, and the same options always give the same files.
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "document_loader.h"
+#include "string_processing.h"
+#include "synthetic_corpus.h"
+
+using namespace std;
+
+namespace {
+
+struct GeneratorOptions {
+    SyntheticCorpusOptions corpus;
+    size_t document_count = 100'000;
+    size_t query_count = 10'000;
+    size_t query_word_count = 3;
+    double minus_word_ratio = 0.1;
+    string documents_path;
+    string queries_path;
+};
+
+const char* const USAGE =
+    "Options:\n"
+    "  --documents_out=PATH      documents file, skipped if not given\n"
+    "  --queries_out=PATH        query log, skipped if not given\n"
+    "  --documents=N             number of documents (100000)\n"
+    "  --queries=N               number of queries (10000)\n"
+    "  --vocabulary=N            distinct words (50000)\n"
+    "  --zipf=S                  Zipf exponent of word frequencies (1.0)\n"
+    "  --length=N                average document length in words (20)\n"
+    "  --length_distribution=D   uniform or lognormal (uniform)\n"
+    "  --stop_words=\"W W...\"     stop words mixed into documents and queries\n"
+    "  --stop_word_density=P     share of words that are stop words (0)\n"
+    "  --query_words=N           words per query (3)\n"
+    "  --minus_ratio=P           share of query words that are minus words (0.1)\n"
+    "  --statuses=A,I,B,R        relative frequencies of ACTUAL, IRRELEVANT, BANNED, REMOVED (1,0,0,0)\n"
+    "  --ratings=N               ratings per document (3)\n"
+    "  --rating_range=MIN,MAX    range of ratings (-10,10)\n"
+    "  --seed=N                  random seed (42)\n";
+
+vector<double> ParseNumbers(const string& text) {
+    vector<double> numbers;
+    size_t start = 0;
+    while (start <= text.size()) {
+        const size_t comma = min(text.find(',', start), text.size());
+        numbers.push_back(stod(text.substr(start, comma - start)));
+        start = comma + 1;
+    }
+    return numbers;
+}
+
+GeneratorOptions ParseOptions(int argc, char* argv[]) {
+    map<string, string> values;
+    for (int i = 1; i < argc; ++i) {
+        const string argument = argv[i];
+        const size_t equals = argument.find('=');
+        if (argument.compare(0, 2, "--"s) != 0 || equals == argument.npos) {
+            throw invalid_argument("Unknown argument "s + argument);
+        }
+        values[argument.substr(2, equals - 2)] = argument.substr(equals + 1);
+    }
+
+    GeneratorOptions options;
+    SyntheticCorpusOptions& corpus = options.corpus;
+    for (const auto& [name, value] : values) {
+        if (name == "documents_out"s) {
+            options.documents_path = value;
+        } else if (name == "queries_out"s) {
+            options.queries_path = value;
+        } else if (name == "documents"s) {
+            options.document_count = stoull(value);
+        } else if (name == "queries"s) {
+            options.query_count = stoull(value);
+        } else if (name == "vocabulary"s) {
+            corpus.vocabulary_size = stoull(value);
+        } else if (name == "zipf"s) {
+            corpus.zipf_exponent = stod(value);
+        } else if (name == "length"s) {
+            corpus.average_document_length = stoull(value);
+        } else if (name == "length_distribution"s) {
+            if (value == "uniform"s) {
+                corpus.length_distribution = DocumentLengthDistribution::UNIFORM;
+            } else if (value == "lognormal"s) {
+                corpus.length_distribution = DocumentLengthDistribution::LOG_NORMAL;
+            } else {
+                throw invalid_argument("Unknown length distribution "s + value);
+            }
+        } else if (name == "stop_words"s) {
+            for (const string_view word : SplitIntoWords(value)) {
+                corpus.stop_words.emplace_back(word);
+            }
+        } else if (name == "stop_word_density"s) {
+            corpus.stop_word_density = stod(value);
+        } else if (name == "query_words"s) {
+            options.query_word_count = stoull(value);
+        } else if (name == "minus_ratio"s) {
+            options.minus_word_ratio = stod(value);
+        } else if (name == "statuses"s) {
+            const auto weights = ParseNumbers(value);
+            if (weights.size() != corpus.status_weights.size()) {
+                throw invalid_argument("--statuses needs four weights"s);
+            }
+            copy(weights.begin(), weights.end(), corpus.status_weights.begin());
+        } else if (name == "ratings"s) {
+            corpus.ratings_per_document = stoull(value);
+        } else if (name == "rating_range"s) {
+            const auto range = ParseNumbers(value);
+            if (range.size() != 2) {
+                throw invalid_argument("--rating_range needs two numbers"s);
+            }
+            corpus.min_rating = static_cast<int>(range[0]);
+            corpus.max_rating = static_cast<int>(range[1]);
+        } else if (name == "seed"s) {
+            corpus.seed = stoull(value);
+        } else {
+            throw invalid_argument("Unknown option --"s + name);
+        }
+    }
+    return options;
+}
+
+void WriteDocuments(const SyntheticCorpus& corpus, const GeneratorOptions& options) {
+    ofstream out(options.documents_path, ios::binary);
+    if (!out) {
+        throw runtime_error("Cannot open "s + options.documents_path);
+    }
+    auto random = corpus.MakeRandom(1);
+    for (size_t id = 0; id < options.document_count; ++id) {
+        out << id << '\t' << DocumentStatusName(corpus.MakeStatus(random)) << '\t';
+        bool first = true;
+        for (const int rating : corpus.MakeRatings(random)) {
+            out << (first ? "" : " ") << rating;
+            first = false;
+        }
+        out << '\t' << corpus.MakeDocument(random) << '\n';
+    }
+    if (!out.flush()) {
+        throw runtime_error("Cannot write "s + options.documents_path);
+    }
+}
+
+void WriteQueries(const SyntheticCorpus& corpus, const GeneratorOptions& options) {
+    ofstream out(options.queries_path, ios::binary);
+    if (!out) {
+        throw runtime_error("Cannot open "s + options.queries_path);
+    }
+    auto random = corpus.MakeRandom(2);
+    for (size_t i = 0; i < options.query_count; ++i) {
+        out << corpus.MakeQuery(random, options.query_word_count, options.minus_word_ratio) << '\n';
+    }
+    if (!out.flush()) {
+        throw runtime_error("Cannot write "s + options.queries_path);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc == 1 || (argc == 2 && argv[1] == "--help"s)) {
+        cerr << "Usage: "s << argv[0] << " --documents_out=PATH --queries_out=PATH [--name=value...]\n"s << USAGE;
+        return argc == 1 ? 1 : 0;
+    }
+
+    try {
+        const GeneratorOptions options = ParseOptions(argc, argv);
+        const SyntheticCorpus corpus(options.corpus);
+        if (!options.documents_path.empty()) {
+            LOG_DURATION("Writing documents"s);
+            WriteDocuments(corpus, options);
+        }
+        if (!options.queries_path.empty()) {
+            LOG_DURATION("Writing queries"s);
+            WriteQueries(corpus, options);
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
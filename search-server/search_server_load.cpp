@@ -0,0 +1,501 @@
+// Replays a query log against an index loaded from a documents file and
+// reports throughput and the latency distribution.
+//
+//     search_server_load --documents=docs.tsv --queries=queries.txt [--name=value...]
+//
+// In the closed loop each client sends its next request as soon as the
+// previous one completes, which measures the peak throughput. In the open loop
+// requests are scheduled at a fixed rate whatever the server does, and latency
+// is counted from the scheduled time rather than from the moment a worker got
+// to the request, so a stalled server shows up in the tail instead of silently
+// slowing the load down (coordinated omission).
+//
+// With --ingest_rate documents from the synthetic corpus are added while the
+// queries run. SearchServer does not allow writes concurrent with reads, so
+// ingestion takes an exclusive lock and its stalls appear in the query latency.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "document_loader.h"
+#include "latency_histogram.h"
+#include "process_queries.h"
+#include "request_queue.h"
+#include "search_metrics.h"
+#include "search_server.h"
+#include "slow_query_log.h"
+#include "synthetic_corpus.h"
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+enum class LoadMode {
+    CLOSED,
+    OPEN,
+};
+
+enum class LoadTarget {
+    FIND,
+    FIND_PAR,
+    PROCESS,
+    QUEUE,
+};
+
+struct LoadOptions {
+    string documents_path;
+    string queries_path;
+    string stop_words;
+    LoadMode mode = LoadMode::CLOSED;
+    LoadTarget target = LoadTarget::FIND;
+    // Concurrent clients in the closed loop, worker threads in the open loop
+    size_t clients = 4;
+    // Requests per second in the open loop
+    double rate = 1000.0;
+    double duration_seconds = 10.0;
+    // Queries per ProcessQueries request
+    size_t batch = 16;
+    // Documents added per second while the queries run, none if 0
+    double ingest_rate = 0.0;
+    uint64_t seed = 42;
+    // Where to write the search metrics after the run, nowhere if empty
+    string metrics_path;
+    MetricsFormat metrics_format = MetricsFormat::PROMETHEUS;
+    // Slow query log, none if the path is empty
+    SlowQueryLogOptions slow_query_log;
+    // Admission control of the queue target
+    RequestQueueOptions request_queue;
+    // Time a queue request may wait for admission, counted from its scheduled
+    // time in the open loop, unlimited if 0
+    chrono::nanoseconds request_deadline{};
+};
+
+const char* const USAGE =
+    "Options:\n"
+    "  --documents=PATH     documents file to load\n"
+    "  --queries=PATH       query log, one query per line\n"
+    "  --stop_words=\"W W...\" stop words of the index\n"
+    "  --mode=M             closed or open (closed)\n"
+    "  --target=T           find, find_par, process or queue (find)\n"
+    "  --clients=N          closed loop clients or open loop workers (4)\n"
+    "  --qps=R              open loop requests per second (1000)\n"
+    "  --duration=S         seconds to run (10)\n"
+    "  --batch=N            queries per request of the process target (16)\n"
+    "  --ingest_rate=R      documents added per second during the run (0)\n"
+    "  --seed=N             seed of the synthetic corpus of ingested documents (42)\n"
+    "  --metrics_out=PATH   file to write the search metrics to after the run\n"
+    "  --metrics_format=F   prometheus or json (prometheus)\n"
+    "  --slow_query_log=PATH  file to append slow and sampled queries to\n"
+    "  --slow_query_ms=T    latency of a slow query in milliseconds (100)\n"
+    "  --slow_query_sample=P  share of the other queries logged anyway (0)\n"
+    "  --max_concurrent=N   queue target: requests searching at once, 0 for no limit (0)\n"
+    "  --max_queued=N       queue target: requests waiting for admission, 0 for no limit (0)\n"
+    "  --max_query_postings=N  queue target: longest total of posting lists admitted (0)\n"
+    "  --degrade_depth=N    queue target: waiting requests from which searches are capped (0)\n"
+    "  --degraded_postings=N  queue target: postings scored per word when capped (10000)\n"
+    "  --deadline_ms=T      queue target: time a request may wait for admission (0)\n";
+
+LoadOptions ParseOptions(int argc, char* argv[]) {
+    map<string, string> values;
+    for (int i = 1; i < argc; ++i) {
+        const string argument = argv[i];
+        const size_t equals = argument.find('=');
+        if (argument.compare(0, 2, "--"s) != 0 || equals == argument.npos) {
+            throw invalid_argument("Unknown argument "s + argument);
+        }
+        values[argument.substr(2, equals - 2)] = argument.substr(equals + 1);
+    }
+
+    LoadOptions options;
+    for (const auto& [name, value] : values) {
+        if (name == "documents"s) {
+            options.documents_path = value;
+        } else if (name == "queries"s) {
+            options.queries_path = value;
+        } else if (name == "stop_words"s) {
+            options.stop_words = value;
+        } else if (name == "mode"s) {
+            if (value == "closed"s) {
+                options.mode = LoadMode::CLOSED;
+            } else if (value == "open"s) {
+                options.mode = LoadMode::OPEN;
+            } else {
+                throw invalid_argument("Unknown mode "s + value);
+            }
+        } else if (name == "target"s) {
+            if (value == "find"s) {
+                options.target = LoadTarget::FIND;
+            } else if (value == "find_par"s) {
+                options.target = LoadTarget::FIND_PAR;
+            } else if (value == "process"s) {
+                options.target = LoadTarget::PROCESS;
+            } else if (value == "queue"s) {
+                options.target = LoadTarget::QUEUE;
+            } else {
+                throw invalid_argument("Unknown target "s + value);
+            }
+        } else if (name == "clients"s) {
+            options.clients = stoull(value);
+        } else if (name == "qps"s) {
+            options.rate = stod(value);
+        } else if (name == "duration"s) {
+            options.duration_seconds = stod(value);
+        } else if (name == "batch"s) {
+            options.batch = stoull(value);
+        } else if (name == "ingest_rate"s) {
+            options.ingest_rate = stod(value);
+        } else if (name == "seed"s) {
+            options.seed = stoull(value);
+        } else if (name == "slow_query_log"s) {
+            options.slow_query_log.path = value;
+        } else if (name == "slow_query_ms"s) {
+            options.slow_query_log.threshold = chrono::duration_cast<chrono::nanoseconds>(chrono::duration<double, milli>(stod(value)));
+        } else if (name == "slow_query_sample"s) {
+            options.slow_query_log.sample_rate = stod(value);
+        } else if (name == "max_concurrent"s) {
+            options.request_queue.max_concurrent_requests = stoull(value);
+        } else if (name == "max_queued"s) {
+            options.request_queue.max_queued_requests = stoull(value);
+        } else if (name == "max_query_postings"s) {
+            options.request_queue.max_query_postings = stoull(value);
+        } else if (name == "degrade_depth"s) {
+            options.request_queue.degrade_queue_depth = stoull(value);
+        } else if (name == "degraded_postings"s) {
+            options.request_queue.degraded_postings_per_term = stoull(value);
+        } else if (name == "deadline_ms"s) {
+            options.request_deadline = chrono::duration_cast<chrono::nanoseconds>(chrono::duration<double, milli>(stod(value)));
+        } else if (name == "metrics_out"s) {
+            options.metrics_path = value;
+        } else if (name == "metrics_format"s) {
+            if (value == "prometheus"s) {
+                options.metrics_format = MetricsFormat::PROMETHEUS;
+            } else if (value == "json"s) {
+                options.metrics_format = MetricsFormat::JSON;
+            } else {
+                throw invalid_argument("Unknown metrics format "s + value);
+            }
+        } else {
+            throw invalid_argument("Unknown option --"s + name);
+        }
+    }
+    if (options.documents_path.empty() || options.queries_path.empty()) {
+        throw invalid_argument("Both --documents and --queries are required"s);
+    }
+    if (options.clients == 0 || options.batch == 0) {
+        throw invalid_argument("--clients and --batch must be positive"s);
+    }
+    if (options.mode == LoadMode::OPEN && options.rate <= 0.0) {
+        throw invalid_argument("--qps must be positive"s);
+    }
+    return options;
+}
+
+vector<string> ReadQueries(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    vector<string> queries;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty()) {
+            queries.push_back(move(line));
+        }
+    }
+    if (queries.empty()) {
+        throw invalid_argument("No queries in "s + path);
+    }
+    return queries;
+}
+
+// Time of the index-th event of a schedule at rate events per second
+Clock::time_point GetScheduledTime(Clock::time_point start, double rate, uint64_t index) {
+    return start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(index / rate));
+}
+
+class LoadGenerator {
+public:
+    LoadGenerator(SearchServer& search_server, vector<string> queries, const LoadOptions& options)
+        : search_server_(search_server)
+        , queries_(move(queries))
+        , options_(options)
+        , request_queue_(search_server, options.request_queue) {
+        for (size_t i = 0; i < queries_.size(); i += options.batch) {
+            batches_.emplace_back(queries_.begin() + i, queries_.begin() + min(i + options.batch, queries_.size()));
+        }
+    }
+
+    void Run() {
+        start_ = Clock::now();
+        deadline_ = start_ + chrono::duration_cast<Clock::duration>(chrono::duration<double>(options_.duration_seconds));
+        thread ingestion;
+        if (options_.ingest_rate > 0.0) {
+            ingestion = thread([this] {
+                Ingest();
+            });
+        }
+        if (options_.mode == LoadMode::CLOSED) {
+            RunClosedLoop();
+        } else {
+            RunOpenLoop();
+        }
+        finish_ = Clock::now();
+        if (ingestion.joinable()) {
+            ingestion.join();
+        }
+        ingestion_finish_ = Clock::now();
+    }
+
+    void PrintReport(ostream& out) const {
+        const double seconds = chrono::duration<double>(finish_ - start_).count();
+        const uint64_t requests = latency_.GetCount();
+        out << fixed << setprecision(1);
+        out << "Requests: "s << requests << " in "s << seconds << " s, "s
+            << requests / seconds << " requests/s, "s
+            << (requests == 0 ? 0.0 : static_cast<double>(result_count_) / requests) << " results per request"s << endl;
+        PrintLatency(out, "Latency"s, latency_);
+        if (options_.target == LoadTarget::QUEUE) {
+            out << "Request queue: "s << request_queue_.GetRequestCount() << " requests, "s
+                << request_queue_.GetNoResultRequests() << " without results ("s
+                << request_queue_.GetNoResultRate() * 100.0 << "%)"s << endl;
+            out << "Rejected: "s << request_queue_.GetRejectedRequests(RejectReason::COST) << " over cost, "s
+                << request_queue_.GetRejectedRequests(RejectReason::QUEUE_FULL) << " queue full, "s
+                << request_queue_.GetRejectedRequests(RejectReason::DEADLINE) << " past deadline; degraded: "s
+                << request_queue_.GetDegradedRequests() << endl;
+        }
+        if (options_.ingest_rate > 0.0) {
+            const double ingestion_seconds = chrono::duration<double>(ingestion_finish_ - start_).count();
+            out << "Ingested: "s << ingestion_latency_.GetCount() << " documents, "s
+                << ingestion_latency_.GetCount() / ingestion_seconds << " documents/s"s << endl;
+            PrintLatency(out, "Ingestion latency"s, ingestion_latency_);
+        }
+    }
+
+private:
+    struct ClientResult {
+        LatencyHistogram latency;
+        uint64_t result_count = 0;
+    };
+
+    SearchServer& search_server_;
+    const vector<string> queries_;
+    vector<vector<string>> batches_;
+    const LoadOptions options_;
+    // Readers share the index, ingestion takes it exclusively
+    shared_mutex index_mutex_;
+    RequestQueue request_queue_;
+    Clock::time_point start_;
+    Clock::time_point deadline_;
+    Clock::time_point finish_;
+    Clock::time_point ingestion_finish_;
+    LatencyHistogram latency_;
+    uint64_t result_count_ = 0;
+    LatencyHistogram ingestion_latency_;
+
+    static void PrintLatency(ostream& out, const string& name, const LatencyHistogram& histogram) {
+        const auto milliseconds = [](chrono::nanoseconds latency) {
+            return chrono::duration<double, milli>(latency).count();
+        };
+        out << setprecision(3) << name << ": p50 "s << milliseconds(histogram.GetPercentile(50))
+            << " ms, p99 "s << milliseconds(histogram.GetPercentile(99))
+            << " ms, p99.9 "s << milliseconds(histogram.GetPercentile(99.9))
+            << " ms, max "s << milliseconds(histogram.GetMax())
+            << " ms, mean "s << milliseconds(histogram.GetMean()) << " ms"s << setprecision(1) << endl;
+    }
+
+    // Returns the number of found documents, nullopt if the request queue rejected the request
+    optional<size_t> ExecuteRequest(uint64_t index, Clock::time_point scheduled) {
+        shared_lock lock(index_mutex_);
+        const string& query = queries_[index % queries_.size()];
+        switch (options_.target) {
+            case LoadTarget::FIND:
+                return search_server_.FindTopDocuments(query).size();
+            case LoadTarget::FIND_PAR:
+                return search_server_.FindTopDocuments(execution::par, query).size();
+            case LoadTarget::PROCESS: {
+                size_t count = 0;
+                for (const auto& documents : ProcessQueries(search_server_, batches_[index % batches_.size()])) {
+                    count += documents.size();
+                }
+                return count;
+            }
+            case LoadTarget::QUEUE: {
+                RequestOptions request_options;
+                if (options_.request_deadline > chrono::nanoseconds::zero()) {
+                    request_options.deadline = scheduled + options_.request_deadline;
+                }
+                try {
+                    return request_queue_.AddFindRequest(query, request_options).size();
+                } catch (const RequestRejectedError&) {
+                    return nullopt;
+                }
+            }
+        }
+        return 0;
+    }
+
+    void MergeResults(const vector<ClientResult>& results) {
+        for (const ClientResult& result : results) {
+            latency_.Merge(result.latency);
+            result_count_ += result.result_count;
+        }
+    }
+
+    void RunClosedLoop() {
+        vector<ClientResult> results(options_.clients);
+        atomic<uint64_t> next_request = 0;
+        vector<thread> clients;
+        for (ClientResult& result : results) {
+            clients.emplace_back([this, &result, &next_request] {
+                while (Clock::now() < deadline_) {
+                    const auto request_start = Clock::now();
+                    if (const auto count = ExecuteRequest(next_request++, request_start)) {
+                        result.result_count += *count;
+                        result.latency.Record(Clock::now() - request_start);
+                    }
+                }
+            });
+        }
+        for (thread& client : clients) {
+            client.join();
+        }
+        MergeResults(results);
+    }
+
+    void RunOpenLoop() {
+        mutex pending_mutex;
+        condition_variable pending_ready;
+        deque<uint64_t> pending;
+        bool dispatched = false;
+
+        vector<ClientResult> results(options_.clients);
+        vector<thread> workers;
+        for (ClientResult& result : results) {
+            workers.emplace_back([&, this] {
+                while (true) {
+                    uint64_t request;
+                    {
+                        unique_lock lock(pending_mutex);
+                        pending_ready.wait(lock, [&] {
+                            return !pending.empty() || dispatched;
+                        });
+                        if (pending.empty()) {
+                            return;
+                        }
+                        request = pending.front();
+                        pending.pop_front();
+                    }
+                    const auto scheduled = GetScheduledTime(start_, options_.rate, request);
+                    if (const auto count = ExecuteRequest(request, scheduled)) {
+                        result.result_count += *count;
+                        result.latency.Record(Clock::now() - scheduled);
+                    }
+                }
+            });
+        }
+
+        // Requests already late when the dispatcher wakes up are released at
+        // once, keeping their scheduled time
+        for (uint64_t request = 0;; ++request) {
+            const auto scheduled = GetScheduledTime(start_, options_.rate, request);
+            if (scheduled >= deadline_) {
+                break;
+            }
+            this_thread::sleep_until(scheduled);
+            {
+                lock_guard lock(pending_mutex);
+                pending.push_back(request);
+            }
+            pending_ready.notify_one();
+        }
+        {
+            lock_guard lock(pending_mutex);
+            dispatched = true;
+        }
+        pending_ready.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        MergeResults(results);
+    }
+
+    // Adds documents on an open-loop schedule after the largest loaded id
+    void Ingest() {
+        SyntheticCorpusOptions corpus_options;
+        corpus_options.seed = options_.seed;
+        const SyntheticCorpus corpus(corpus_options);
+        auto random = corpus.MakeRandom(3);
+        int next_id = 0;
+        {
+            shared_lock lock(index_mutex_);
+            next_id = search_server_.begin() == search_server_.end() ? 0 : *prev(search_server_.end()) + 1;
+        }
+        for (uint64_t document = 0;; ++document) {
+            const auto scheduled = GetScheduledTime(start_, options_.ingest_rate, document);
+            if (scheduled >= deadline_) {
+                break;
+            }
+            const string text = corpus.MakeDocument(random);
+            const DocumentStatus status = corpus.MakeStatus(random);
+            const vector<int> ratings = corpus.MakeRatings(random);
+            this_thread::sleep_until(scheduled);
+            {
+                unique_lock lock(index_mutex_);
+                search_server_.AddDocument(next_id++, text, status, ratings);
+            }
+            ingestion_latency_.Record(Clock::now() - scheduled);
+        }
+    }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc == 1 || (argc == 2 && argv[1] == "--help"s)) {
+        cerr << "Usage: "s << argv[0] << " --documents=PATH --queries=PATH [--name=value...]\n"s << USAGE;
+        return argc == 1 ? 1 : 0;
+    }
+
+    try {
+        const LoadOptions options = ParseOptions(argc, argv);
+        SearchServer search_server(options.stop_words);
+        {
+            LOG_DURATION("Loading documents"s);
+            cerr << "Loaded "s << LoadDocuments(search_server, options.documents_path) << " documents"s << endl;
+        }
+        shared_ptr<SlowQueryLog> slow_query_log;
+        if (!options.slow_query_log.path.empty()) {
+            slow_query_log = make_shared<SlowQueryLog>(options.slow_query_log);
+            search_server.SetSlowQueryLog(slow_query_log);
+        }
+        LoadGenerator generator(search_server, ReadQueries(options.queries_path), options);
+        generator.Run();
+        generator.PrintReport(cout);
+        if (slow_query_log) {
+            slow_query_log->Flush();
+            cout << "Slow query log: "s << slow_query_log->GetLoggedCount() << " queries logged, "s
+                 << slow_query_log->GetDroppedCount() << " dropped"s << endl;
+        }
+        if (!options.metrics_path.empty()) {
+            WriteMetrics(options.metrics_path, options.metrics_format);
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
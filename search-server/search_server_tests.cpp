@@ -0,0 +1,971 @@
+// Behaviour tests of the search server
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <future>
+#include <iostream>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "search_server.h"
+#include "stemming.h"
+#include "query_trace.h"
+#include "string_processing.h"
+
+using namespace std;
+
+namespace {
+
+template <typename First, typename Second>
+ostream& operator<<(ostream& out, const pair<First, Second>& value) {
+    return out << '(' << value.first << ", "s << value.second << ')';
+}
+
+template <typename Element>
+ostream& operator<<(ostream& out, const vector<Element>& container) {
+    out << '[';
+    bool is_first = true;
+    for (const Element& element : container) {
+        out << (is_first ? ""s : ", "s) << element;
+        is_first = false;
+    }
+    return out << ']';
+}
+
+template <typename T, typename U>
+void AssertEqualImpl(const T& t, const U& u, const string& t_str, const string& u_str, const string& file,
+                     const string& func, unsigned line, const string& hint) {
+    if (t != u) {
+        cerr << boolalpha << file << "("s << line << "): "s << func << ": "s
+             << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s << t << " != "s << u << "."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+                const string& hint) {
+    if (!value) {
+        cerr << file << "("s << line << "): "s << func << ": "s << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+#define ASSERT_INVALID_QUERY(server, query)                                                          \
+    do {                                                                                             \
+        bool thrown = false;                                                                         \
+        try {                                                                                        \
+            (server).FindTopDocuments(query);                                                        \
+        } catch (const invalid_argument&) {                                                          \
+            thrown = true;                                                                           \
+        }                                                                                            \
+        AssertImpl(thrown, "invalid query "s + (query), __FILE__, __FUNCTION__, __LINE__, ""s);      \
+    } while (false)
+
+template <typename TestFunc>
+void RunTestImpl(TestFunc func, const string& test_name) {
+    func();
+    cerr << test_name << " OK"s << endl;
+}
+
+#define RUN_TEST(func) RunTestImpl((func), #func)
+
+// Ids of the found documents in ascending order
+vector<int> FindIds(const SearchServer& server, const string& query) {
+    vector<int> ids;
+    for (const Document& document : server.FindTopDocuments(query)) {
+        ids.push_back(document.id);
+    }
+    sort(ids.begin(), ids.end());
+    return ids;
+}
+
+double FindRelevance(const SearchServer& server, const string& query, int document_id) {
+    for (const Document& document : server.FindTopDocuments(query)) {
+        if (document.id == document_id) {
+            return document.relevance;
+        }
+    }
+    return 0.0;
+}
+
+bool IsNear(double lhs, double rhs) {
+    return abs(lhs - rhs) < EPSILON;
+}
+
+void TestRemoveDocuments() {
+    SearchServer server(""s);
+    server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, {3});
+
+    server.RemoveDocument(2);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(FindIds(server, "cat bird"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "bird"s), vector<int>());
+    ASSERT(server.GetWordFrequencies(2).empty());
+    bool thrown = false;
+    try {
+        server.MatchDocument("cat"s, 2);
+    } catch (const out_of_range&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    // The words of no document left leave the dictionary
+    ASSERT_EQUAL(server.FindWordsByPrefix("b"s, 5), vector<string>());
+    // Unknown ids are ignored
+    server.RemoveDocument(2);
+    server.RemoveDocument(42);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+
+    // The new word takes the slot of bird and must not inherit its postings,
+    // and the reused id gets only the words of its new text
+    server.AddDocument(4, "fish"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(2, "fish"s, DocumentStatus::ACTUAL, {2});
+    ASSERT_EQUAL(FindIds(server, "fish"s), vector<int>({2, 4}));
+    ASSERT_EQUAL(FindIds(server, "cat"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "bird"s), vector<int>());
+    {
+        const auto [words, status] = server.MatchDocument("cat dog fish"s, 2);
+        ASSERT_EQUAL(words, vector<string_view>({"fish"sv}));
+    }
+
+    // Bulk removal gives the same index with either policy
+    SearchServer parallel_server(""s);
+    for (SearchServer* target : {&server, &parallel_server}) {
+        target->AddDocument(5, "cat dog fish"s, DocumentStatus::ACTUAL, {5});
+        target->AddDocument(6, "dog"s, DocumentStatus::ACTUAL, {6});
+        target->AddDocument(7, "cat"s, DocumentStatus::ACTUAL, {7});
+    }
+    server.RemoveDocuments({5, 7, 42});
+    parallel_server.RemoveDocuments(execution::par, {5, 7, 42});
+    ASSERT_EQUAL(FindIds(server, "cat dog fish"s), vector<int>({1, 2, 3, 4, 6}));
+    ASSERT_EQUAL(FindIds(parallel_server, "cat dog fish"s), vector<int>({6}));
+    ASSERT_EQUAL(parallel_server.FindWordsByPrefix("c"s, 5), vector<string>());
+}
+
+void TestCompact() {
+    SearchServer server("and"s);
+    for (int id = 0; id < 50; ++id) {
+        server.AddDocument(id, "word"s + to_string(id % 7) + " and word"s + to_string(id % 11) + " common"s,
+                           DocumentStatus::ACTUAL, {id});
+    }
+    vector<int> removed_ids;
+    for (int id = 0; id < 50; id += 3) {
+        removed_ids.push_back(id);
+    }
+    server.RemoveDocuments(removed_ids);
+
+    const vector<string> queries = {"word1"s, "word2 word3 -word5"s, "common"s, "word* -word4"s, "word6 word10"s};
+    vector<vector<Document>> before;
+    for (const string& query : queries) {
+        before.push_back(server.FindTopDocuments(query));
+    }
+    server.Compact();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const vector<Document> after = server.FindTopDocuments(queries[i]);
+        ASSERT_EQUAL_HINT(after.size(), before[i].size(), queries[i]);
+        for (size_t j = 0; j < after.size(); ++j) {
+            ASSERT_EQUAL_HINT(after[j].id, before[i][j].id, queries[i]);
+            ASSERT_EQUAL_HINT(after[j].relevance, before[i][j].relevance, queries[i]);
+            ASSERT_EQUAL_HINT(after[j].rating, before[i][j].rating, queries[i]);
+        }
+    }
+    {
+        const auto [words, status] = server.MatchDocument("word1 word2 common"s, 1);
+        ASSERT_EQUAL(words, vector<string_view>({"common"sv, "word1"sv}));
+    }
+
+    // The compacted index keeps working
+    server.AddDocument(100, "word1 fresh"s, DocumentStatus::ACTUAL, {1});
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(FindIds(server, "fresh"s), vector<int>({100}));
+    ASSERT_EQUAL(server.GetDocumentCount(), 33);
+}
+
+// Words word<first>..word<last - 1> joined by spaces
+string MakeWordRange(int first, int last) {
+    string text;
+    for (int i = first; i < last; ++i) {
+        text += (text.empty() ? ""s : " "s) + "word"s + to_string(i);
+    }
+    return text;
+}
+
+void TestFindDuplicates() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1});
+    // Word order, repeats and stop words do not matter
+    server.AddDocument(3, "nasty rat funny pet funny"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(4, "funny pet with nasty rat"s, DocumentStatus::ACTUAL, {1});
+    // A subset of the words is not a duplicate
+    server.AddDocument(5, "funny pet curly"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(6, "curly hair funny pet"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetWordSetFingerprint(1), server.GetWordSetFingerprint(3));
+    ASSERT_EQUAL(FindDuplicates(server), vector<int>({3, 4, 6}));
+    // Exact duplicates are near-duplicates at any threshold
+    NearDuplicateOptions exact;
+    exact.similarity_threshold = 1.0;
+    ASSERT_EQUAL(FindNearDuplicates(server, exact), vector<int>({3, 4, 6}));
+
+    RemoveDuplicates(server);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({1, 2, 5}));
+    ASSERT_EQUAL(FindDuplicates(server), vector<int>());
+}
+
+void TestFindNearDuplicates() {
+    SearchServer server(""s);
+    server.AddDocument(1, MakeWordRange(0, 40), DocumentStatus::ACTUAL, {1});
+    // Jaccard similarity 39/41 to document 1
+    server.AddDocument(2, MakeWordRange(1, 41), DocumentStatus::ACTUAL, {1});
+    // 20/60 to document 1
+    server.AddDocument(3, MakeWordRange(20, 60), DocumentStatus::ACTUAL, {1});
+    // 30/50 to document 1, and to document 3
+    server.AddDocument(4, MakeWordRange(10, 50), DocumentStatus::ACTUAL, {1});
+    server.AddDocument(5, "unrelated text"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(FindNearDuplicates(server), vector<int>({2}));
+    ASSERT_EQUAL(FindDuplicates(server), vector<int>());
+
+    // Documents are compared with kept ones only, so 3 stays although it is
+    // as similar to 4 as 4 is to 1
+    NearDuplicateOptions loose;
+    loose.similarity_threshold = 0.5;
+    loose.band_count = 32;
+    loose.rows_per_band = 2;
+    ASSERT_EQUAL(FindNearDuplicates(server, loose), vector<int>({2, 4}));
+
+    RemoveNearDuplicates(server);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({1, 3, 4, 5}));
+
+    NearDuplicateOptions invalid;
+    invalid.band_count = 0;
+    bool thrown = false;
+    try {
+        FindNearDuplicates(server, invalid);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+void TestDuplicatePolicy() {
+    // (document id, id of the document it duplicates)
+    using Report = pair<int, int>;
+    vector<Report> reports;
+    const auto report = [&reports](int document_id, int duplicate_of) {
+        reports.push_back({document_id, duplicate_of});
+    };
+    const auto make_server = [] {
+        SearchServer server("and"s);
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(2, "curly hair"s, DocumentStatus::ACTUAL, {2});
+        return server;
+    };
+
+    {
+        SearchServer server = make_server();
+        server.SetDuplicatePolicy(DuplicatePolicy::ALLOW, report);
+        server.AddDocument(3, "nasty rat funny pet"s, DocumentStatus::ACTUAL, {3});
+        ASSERT(reports.empty());
+        ASSERT_EQUAL(FindIds(server, "rat"s), vector<int>({1, 3}));
+    }
+    {
+        // Documents added before the policy was set are indexed too
+        SearchServer server = make_server();
+        server.SetDuplicatePolicy(DuplicatePolicy::REJECT, report);
+        bool thrown = false;
+        try {
+            server.AddDocument(3, "nasty rat funny pet"s, DocumentStatus::ACTUAL, {3});
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        ASSERT(thrown);
+        ASSERT_EQUAL(reports, vector<Report>({{3, 1}}));
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_EQUAL(FindIds(server, "rat"s), vector<int>({1}));
+        // A near-duplicate is not an exact one
+        server.AddDocument(4, "funny pet and nasty rat tail"s, DocumentStatus::ACTUAL, {4});
+        ASSERT_EQUAL(FindIds(server, "rat"s), vector<int>({1, 4}));
+        ASSERT_EQUAL(reports.size(), 1u);
+    }
+    reports.clear();
+    {
+        SearchServer server = make_server();
+        server.SetDuplicatePolicy(DuplicatePolicy::REPLACE, report);
+        server.AddDocument(3, "nasty rat funny pet"s, DocumentStatus::ACTUAL, {3});
+        ASSERT_EQUAL(reports, vector<Report>({{3, 1}}));
+        ASSERT_EQUAL(FindIds(server, "rat"s), vector<int>({3}));
+        server.AddDocument(4, "rat funny nasty pet"s, DocumentStatus::ACTUAL, {4});
+        ASSERT_EQUAL(reports, vector<Report>({{3, 1}, {4, 3}}));
+        ASSERT_EQUAL(FindIds(server, "rat curly"s), vector<int>({2, 4}));
+    }
+    reports.clear();
+    {
+        SearchServer server = make_server();
+        server.SetDuplicatePolicy(DuplicatePolicy::REPORT, report);
+        server.AddDocument(3, "nasty rat funny pet"s, DocumentStatus::ACTUAL, {3});
+        server.AddDocument(4, "hair curly curly"s, DocumentStatus::ACTUAL, {4});
+        ASSERT_EQUAL(reports, vector<Report>({{3, 1}, {4, 2}}));
+        ASSERT_EQUAL(FindIds(server, "rat curly"s), vector<int>({1, 2, 3, 4}));
+
+        // Removal and compaction keep the fingerprint index in sync
+        reports.clear();
+        server.RemoveDocuments({1, 3});
+        server.AddDocument(5, "funny pet nasty rat"s, DocumentStatus::ACTUAL, {5});
+        ASSERT(reports.empty());
+        server.Compact();
+        server.AddDocument(6, "curly hair"s, DocumentStatus::ACTUAL, {6});
+        ASSERT_EQUAL(reports, vector<Report>({{6, 2}}));
+    }
+}
+
+// Checks the ids and relevances of the found documents in ranking order
+void CheckRanking(const SearchServer& server, const string& query, const vector<pair<int, double>>& expected) {
+    const vector<Document> documents = server.FindTopDocuments(query);
+    ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ASSERT_EQUAL_HINT(documents[i].id, expected[i].first, query);
+        ASSERT_HINT(IsNear(documents[i].relevance, expected[i].second), query);
+    }
+}
+
+// Document lengths 2, 3, 2 and 36, 43 / 4 on average. With 4 documents
+// idf(cat) = ln(1 + (4 - 3 + 0.5) / (3 + 0.5)) = ln(10 / 7) and idf(mouse) = ln(2).
+SearchServer MakeBm25Server() {
+    SearchServer server(""s);
+    server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat cat mouse"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "bird mouse"s, DocumentStatus::ACTUAL, {3});
+    string long_text = "cat"s;
+    for (int i = 0; i < 35; ++i) {
+        long_text += " filler"s + to_string(i);
+    }
+    server.AddDocument(4, long_text, DocumentStatus::ACTUAL, {4});
+    return server;
+}
+
+void TestBm25() {
+    SearchServer server = MakeBm25Server();
+    server.SetScorer(Bm25Scorer{});
+    // idf * count * 2.2 / (count + 1.2 * (0.25 + 0.75 * length / 10.75)) per word
+    CheckRanking(server, "cat"s, {{2, 0.615158609}, {1, 0.534729789}, {4, 0.181894608}});
+    CheckRanking(server, "mouse"s, {{3, 1.039171526}, {2, 0.983084307}});
+    CheckRanking(server, "cat mouse"s, {{2, 1.598242916}, {3, 1.039171526}, {1, 0.534729789}, {4, 0.181894608}});
+    CheckRanking(server, "cat -dog"s, {{2, 0.615158609}, {4, 0.181894608}});
+    // Saturation: three times the count is far from three times the score
+    const Bm25Scorer scorer;
+    const CorpusStats corpus{4, 43.0 / 4};
+    const double weight = scorer.ComputeTermWeight(corpus, 3);
+    ASSERT(IsNear(weight, log(10.0 / 7)));
+    ASSERT(scorer.ComputeScore(corpus, weight, 3.0 / 3, 3) < 2 * scorer.ComputeScore(corpus, weight, 1.0 / 3, 3));
+}
+
+void TestBm25Plus() {
+    SearchServer server = MakeBm25Server();
+    server.SetScorer(Bm25PlusScorer{});
+    // The BM25 scores plus idf * delta per matched word, with delta 1
+    CheckRanking(server, "cat"s, {{2, 0.971833553}, {1, 0.891404733}, {4, 0.538569551}});
+    CheckRanking(server, "cat mouse"s, {{2, 2.648065040}, {3, 1.732318706}, {1, 0.891404733}, {4, 0.538569551}});
+
+    // Whatever the length, a match scores at least idf * delta, while plain
+    // BM25 drops to almost nothing; document 4 is already below that bound
+    const Bm25PlusScorer scorer;
+    const CorpusStats corpus{4, 43.0 / 4};
+    const double weight = scorer.ComputeTermWeight(corpus, 3);
+    ASSERT(FindRelevance(server, "cat"s, 4) >= weight * scorer.delta);
+    server.SetScorer(Bm25Scorer{});
+    ASSERT(FindRelevance(server, "cat"s, 4) < weight * scorer.delta);
+    for (const int length : {1000, 1000000}) {
+        const double term_freq = 1.0 / length;
+        ASSERT_HINT(scorer.ComputeScore(corpus, weight, term_freq, length) >= weight * scorer.delta, to_string(length));
+        ASSERT_HINT(Bm25Scorer{}.ComputeScore(corpus, weight, term_freq, length) < weight * 0.05, to_string(length));
+    }
+}
+
+void TestScoreKernels() {
+    // Blocks of every length up to two vector widths past SCORE_BLOCK_SIZE,
+    // so each kernel also runs its scalar tail
+    const size_t max_count = SCORE_BLOCK_SIZE + 16;
+    vector<double> term_freqs(max_count);
+    vector<int> document_lengths(max_count);
+    for (size_t i = 0; i < max_count; ++i) {
+        document_lengths[i] = 1 + static_cast<int>(i * 37 % 500);
+        term_freqs[i] = (1.0 + static_cast<double>(i % 9)) / document_lengths[i];
+    }
+    const CorpusStats corpus{1000, 123.25};
+    const double weight = 1.75;
+    for (const AnyScorer& scorer : {AnyScorer(TfIdfScorer{}), AnyScorer(Bm25Scorer{}), AnyScorer(Bm25PlusScorer{0.9, 0.4, 0.5})}) {
+        vector<double> expected(max_count);
+        ComputeScores(scorer, SimdLevel::SCALAR, corpus, weight, term_freqs.data(), document_lengths.data(),
+                      expected.data(), max_count);
+        for (size_t i = 0; i < max_count; ++i) {
+            const double score = visit([&](const auto& concrete_scorer) {
+                return concrete_scorer.ComputeScore(corpus, weight, term_freqs[i], document_lengths[i]);
+            }, scorer);
+            ASSERT(IsNear(expected[i], score));
+        }
+
+        for (const SimdLevel level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > GetSimdLevel()) {
+                continue;
+            }
+            for (size_t count = 0; count <= max_count; ++count) {
+                // The first entry is skipped so the loads are not aligned either
+                const size_t offset = count < max_count ? 1 : 0;
+                vector<double> scores(count);
+                ComputeScores(scorer, level, corpus, weight, term_freqs.data() + offset, document_lengths.data() + offset,
+                              scores.data(), count);
+                // Bit-identical, not only close
+                ASSERT_EQUAL_HINT(scores, vector<double>(expected.begin() + offset, expected.begin() + offset + count),
+                                  "level "s + to_string(static_cast<int>(level)) + ", count "s + to_string(count));
+            }
+        }
+    }
+}
+
+void TestScoreAccumulator() {
+    const vector<int> document_ids = {3, 5000, 70000, 70001, 900000};
+    const vector<double> scores = {1.0, 2.0, 3.0, 4.0, 5.0};
+    ScoreAccumulator dense(0, 1000000, 100000, pmr::get_default_resource());
+    ScoreAccumulator sparse(0, 1000000, document_ids.size(), pmr::get_default_resource());
+    ASSERT(dense.IsDense());
+    ASSERT(!sparse.IsDense());
+
+    for (ScoreAccumulator* accumulator : {&dense, &sparse}) {
+        accumulator->Add(document_ids.data(), scores.data(), document_ids.size());
+        accumulator->Add(document_ids.data() + 1, scores.data() + 1, 2);
+        accumulator->Exclude(70001);
+        accumulator->Exclude(12);
+        using Score = pair<int, double>;
+        vector<Score> result;
+        accumulator->ForEach([&result](int document_id, double relevance) {
+            result.push_back({document_id, relevance});
+        });
+        ASSERT_EQUAL(result, vector<Score>({{3, 1.0}, {5000, 4.0}, {70000, 6.0}, {900000, 5.0}}));
+    }
+    ASSERT_EQUAL(dense.GetSlotCount(), 1000001u);
+    ASSERT_EQUAL(sparse.GetSlotCount(), 4u);
+}
+
+void TestParallelRanking() {
+    const vector<string> vocabulary = {"cat"s, "dog"s, "bird"s, "fish"s, "white"s, "black"s, "fluffy"s,
+                                       "tail"s, "collar"s, "eyes"s, "and"s, "in"s};
+    const vector<string> queries = {"cat"s, "white cat -tail"s, "fluffy dog bird and"s, "fish collar eyes -cat"s,
+                                    "black tail"s, "cat dog bird fish"s};
+    // Consecutive ids give dense accumulators, ids 100003 apart sparse ones
+    // and parallel shards that own few documents or none
+    for (const int id_step : {1, 100003}) {
+        SearchServer server("and in"s);
+        for (int i = 0; i < 300; ++i) {
+            string text;
+            for (int j = 0; j <= i % 6; ++j) {
+                text += vocabulary[(i * 7 + j * j * 3) % vocabulary.size()] + " "s;
+            }
+            // Unique ratings order documents of equal relevance the same under both policies
+            server.AddDocument(1 + i * id_step, text, DocumentStatus::ACTUAL, {i});
+        }
+        for (const AnyScorer& scorer : {AnyScorer(TfIdfScorer{}), AnyScorer(Bm25Scorer{}), AnyScorer(Bm25PlusScorer{})}) {
+            server.SetScorer(scorer);
+            for (const string& query : queries) {
+                for (int remainder = 0; remainder < 7; ++remainder) {
+                    const auto predicate = [id_step, remainder](int document_id, DocumentStatus, int) {
+                        return (document_id - 1) / id_step % 7 == remainder;
+                    };
+                    QueryTrace seq_trace;
+                    QueryTrace par_trace;
+                    const vector<Document> seq = server.FindTopDocuments(execution::seq, query, predicate, QueryOptions{&seq_trace});
+                    const vector<Document> par = server.FindTopDocuments(execution::par, query, predicate, QueryOptions{&par_trace});
+                    const string hint = query + ", id step "s + to_string(id_step) + ", remainder "s + to_string(remainder);
+                    ASSERT_EQUAL_HINT(seq.size(), par.size(), hint);
+                    for (size_t i = 0; i < seq.size(); ++i) {
+                        ASSERT_EQUAL_HINT(seq[i].id, par[i].id, hint);
+                        ASSERT_EQUAL_HINT(seq[i].relevance, par[i].relevance, hint);
+                        ASSERT_EQUAL_HINT(seq[i].rating, par[i].rating, hint);
+                    }
+                    ASSERT_HINT(!seq.empty(), hint);
+                    ASSERT_EQUAL_HINT(seq_trace.dense_accumulators, id_step == 1 ? 1u : 0u, hint);
+                    ASSERT_HINT((par_trace.dense_accumulators > 0) == (id_step == 1), hint);
+                }
+            }
+        }
+    }
+}
+
+SearchServer MakePositionalServer() {
+    SearchServerOptions options;
+    options.store_positions = true;
+    SearchServer server("in the"s, options);
+    server.AddDocument(1, "white cat in the hat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat white hat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "white fluffy cat"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "cat hat"s, DocumentStatus::ACTUAL, {4});
+    return server;
+}
+
+void TestPhrases() {
+    const SearchServer server = MakePositionalServer();
+    ASSERT_EQUAL(FindIds(server, "\"white cat\""s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "\"cat white\""s), vector<int>({2}));
+    ASSERT_EQUAL(FindIds(server, "\"White, Cat!\""s), vector<int>({1}));
+    // Stop words keep their positions
+    ASSERT_EQUAL(FindIds(server, "\"cat in the hat\""s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "\"cat hat\""s), vector<int>({4}));
+    // A phrase word alone matches anywhere and the phrase words add relevance
+    ASSERT_EQUAL(FindIds(server, "\"cat\""s), vector<int>({1, 2, 3, 4}));
+    ASSERT_EQUAL(FindIds(server, "fluffy \"white cat\""s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "\"white cat\" -hat"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "\"white cat\" \"cat in\""s), vector<int>({1}));
+    // An empty phrase constrains nothing
+    ASSERT_EQUAL(FindIds(server, "fluffy \"\""s), vector<int>({3}));
+
+    ASSERT_INVALID_QUERY(server, "\"white cat"s);
+    ASSERT_INVALID_QUERY(server, "\"white -cat\""s);
+    ASSERT_INVALID_QUERY(server, "\"white ca*\""s);
+    ASSERT_INVALID_QUERY(server, "\"white cat~\""s);
+
+    SearchServer without_positions("in the"s);
+    without_positions.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_INVALID_QUERY(without_positions, "\"white cat\""s);
+    ASSERT_INVALID_QUERY(without_positions, "white NEAR/1 cat"s);
+}
+
+void TestProximity() {
+    const SearchServer server = MakePositionalServer();
+    ASSERT_EQUAL(FindIds(server, "white NEAR/1 cat"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "white NEAR/2 cat"s), vector<int>({1, 2, 3}));
+    ASSERT_EQUAL(FindIds(server, "cat NEAR/3 hat"s), vector<int>({1, 2, 4}));
+    ASSERT_EQUAL(FindIds(server, "cat NEAR/1 hat"s), vector<int>({4}));
+    ASSERT_EQUAL(FindIds(server, "white NEAR/1 cat NEAR/2 hat"s), vector<int>({2}));
+    ASSERT_EQUAL(FindIds(server, "white NEAR/1 cat -hat"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "dog NEAR/5 cat"s), vector<int>());
+
+    ASSERT_INVALID_QUERY(server, "NEAR/1 cat"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/1"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/1 -hat"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/1 the"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/x hat"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/ hat"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/-1 hat"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/1 ha*"s);
+    ASSERT_INVALID_QUERY(server, "cat NEAR/1 hat~"s);
+}
+
+SearchServer MakeAnimalServer() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(4, "groomed cot in the cabin"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(5, "cats and dogs"s, DocumentStatus::BANNED, {1});
+    return server;
+}
+
+void TestRequiredWords() {
+    const SearchServer server = MakeAnimalServer();
+    ASSERT_EQUAL(FindIds(server, "+cat groomed"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "+cat +fluffy"s), vector<int>({2}));
+    ASSERT_EQUAL(FindIds(server, "+cat +groomed"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "+cat -fluffy"s), vector<int>({1}));
+    // The minus word wins over the same required word
+    ASSERT_EQUAL(FindIds(server, "+cat -cat"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "+unknown cat"s), vector<int>());
+    // A required stop word constrains nothing
+    ASSERT_EQUAL(FindIds(server, "+in cat"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "+cat +cat"s), vector<int>({1, 2}));
+    // Required words are scored like plus words
+    ASSERT(IsNear(FindRelevance(server, "+fluffy cat"s, 2), FindRelevance(server, "fluffy cat"s, 2)));
+
+    ASSERT_INVALID_QUERY(server, "+"s);
+    ASSERT_INVALID_QUERY(server, "-"s);
+    ASSERT_INVALID_QUERY(server, "++cat"s);
+    ASSERT_INVALID_QUERY(server, "+-cat"s);
+    ASSERT_INVALID_QUERY(server, "--cat"s);
+    ASSERT_INVALID_QUERY(server, "-+cat"s);
+    ASSERT_INVALID_QUERY(server, "cat\x12"s);
+}
+
+void TestMatchesWildcard() {
+    ASSERT(MatchesWildcard("ca*"s, "cat"s));
+    ASSERT(MatchesWildcard("ca*"s, "ca"s));
+    ASSERT(MatchesWildcard("c?t"s, "cot"s));
+    ASSERT(!MatchesWildcard("c?t"s, "coat"s));
+    ASSERT(!MatchesWildcard("c?t"s, "ct"s));
+    ASSERT(MatchesWildcard("*"s, ""s));
+    ASSERT(MatchesWildcard("*at"s, "at"s));
+    ASSERT(MatchesWildcard("*a*t*"s, "abracadabrat"s));
+    ASSERT(!MatchesWildcard("*a*t"s, "abracadabra"s));
+    ASSERT(MatchesWildcard("c**t"s, "cut"s));
+    ASSERT(!MatchesWildcard("cat"s, "cats"s));
+}
+
+void TestPatterns() {
+    const SearchServer server = MakeAnimalServer();
+    ASSERT_EQUAL(FindIds(server, "ca*"s), vector<int>({1, 2, 4}));
+    ASSERT_EQUAL(FindIds(server, "c?t"s), vector<int>({1, 2, 4}));
+    ASSERT_EQUAL(FindIds(server, "c?t -fluffy"s), vector<int>({1, 4}));
+    ASSERT_EQUAL(FindIds(server, "*ed"s), vector<int>({3, 4}));
+    ASSERT_EQUAL(FindIds(server, "groomed -c*"s), vector<int>({3}));
+    ASSERT_EQUAL(FindIds(server, "x*"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "Ca*"s), vector<int>({1, 2, 4}));
+
+    // A word matched by several query words is scored once
+    const double cat_relevance = FindRelevance(server, "cat"s, 1);
+    for (const string& query : {"cat ca*"s, "ca* cat"s, "cat c*t"s, "ca* c?t"s, "cat c?t ca*"s}) {
+        ASSERT_HINT(IsNear(FindRelevance(server, query, 1), cat_relevance), query);
+    }
+
+    ASSERT_INVALID_QUERY(server, "+ca*"s);
+
+    SearchServerOptions options;
+    options.max_pattern_expansions = 1;
+    SearchServer limited(""s, options);
+    limited.AddDocument(1, "cab"s, DocumentStatus::ACTUAL, {1});
+    limited.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+    limited.AddDocument(3, "cat"s, DocumentStatus::ACTUAL, {1});
+    // The most frequent expansion is kept
+    ASSERT_EQUAL(FindIds(limited, "ca*"s), vector<int>({2, 3}));
+    ASSERT_EQUAL(limited.FindWordsByPrefix("c"s, 5), vector<string>({"cat"s, "cab"s}));
+    ASSERT_EQUAL(limited.FindWordsByPrefix("c"s, 1), vector<string>({"cat"s}));
+
+    options.max_pattern_expansions = 64;
+    options.max_pattern_scan = 2;
+    SearchServer scan_limited(""s, options);
+    scan_limited.AddDocument(1, "bat cab cad cat"s, DocumentStatus::ACTUAL, {1});
+    scan_limited.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+    // Only the first two words with the prefix are examined
+    ASSERT_EQUAL(FindIds(scan_limited, "c?t"s), vector<int>());
+    ASSERT_EQUAL(scan_limited.FindWordsByPrefix("ca"s, 5), vector<string>({"cab"s, "cad"s}));
+}
+
+void TestFuzzyWords() {
+    SearchServer server(""s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cats"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "bat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(4, "coast"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(5, "dog"s, DocumentStatus::ACTUAL, {1});
+
+    // cat is a prefix of cats, so the rows of cat are reused for cats and the next words
+    ASSERT_EQUAL(FindIds(server, "cat~"s), vector<int>({1, 2, 3}));
+    ASSERT_EQUAL(FindIds(server, "cat~0"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "cat~2"s), vector<int>({1, 2, 3, 4}));
+    ASSERT_EQUAL(FindIds(server, "cats~1"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "ca~1"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "CAT~"s), vector<int>({1, 2, 3}));
+    ASSERT_EQUAL(FindIds(server, "cat~ -bat"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "dog -cat~"s), vector<int>({5}));
+    ASSERT_EQUAL(FindIds(server, "dot~ -cat~"s), vector<int>({5}));
+
+    // Every edit halves the score with the default penalty
+    ASSERT(IsNear(FindRelevance(server, "cat~"s, 3), FindRelevance(server, "bat"s, 3) * 0.5));
+    ASSERT(IsNear(FindRelevance(server, "cat~"s, 1), FindRelevance(server, "cat"s, 1)));
+
+    // A word matched by several query words is scored once, at its closest match
+    const double cat_relevance = FindRelevance(server, "cat"s, 1);
+    for (const string& query : {"cat cat~"s, "cat~ cat"s, "ca* cat~"s, "cat~ cats~"s, "cats~ cat~"s, "cat~ cat~2"s}) {
+        ASSERT_HINT(IsNear(FindRelevance(server, query, 1), cat_relevance), query);
+    }
+
+    ASSERT_INVALID_QUERY(server, "~"s);
+    ASSERT_INVALID_QUERY(server, "cat~3"s);
+    ASSERT_INVALID_QUERY(server, "+cat~"s);
+
+    SearchServer prefixes(""s);
+    prefixes.AddDocument(1, "a ab abc abcd b ba"s, DocumentStatus::ACTUAL, {1});
+    prefixes.AddDocument(2, "abcde"s, DocumentStatus::ACTUAL, {1});
+    prefixes.AddDocument(3, "bac"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(FindIds(prefixes, "abcde~"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(prefixes, "bc~1"s), vector<int>({1, 3}));
+    ASSERT_EQUAL(FindIds(prefixes, "abcdef~"s), vector<int>({2}));
+}
+
+void TestMatchDocument() {
+    const SearchServer server = MakeAnimalServer();
+    {
+        const auto [words, status] = server.MatchDocument("+fluffy cat"s, 2);
+        ASSERT_EQUAL(words, vector<string_view>({"cat"sv, "fluffy"sv}));
+        ASSERT(status == DocumentStatus::ACTUAL);
+    }
+    {
+        const auto [words, status] = server.MatchDocument("+fluffy cat"s, 1);
+        ASSERT(words.empty());
+    }
+    {
+        const auto [words, status] = server.MatchDocument("ca* cat~ fluffy"s, 2);
+        ASSERT_EQUAL(words, vector<string_view>({"cat"sv, "fluffy"sv}));
+    }
+    {
+        const auto [words, status] = server.MatchDocument("cat -fl*"s, 2);
+        ASSERT(words.empty());
+    }
+}
+
+void TestNormalization() {
+    SearchServerOptions options;
+    options.normalization.remove_diacritics = true;
+    SearchServer server("The"s, options);
+    server.AddDocument(1, "The Café, (open)!"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "e-mail 3.14"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(FindIds(server, "cafe"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "CAFÉ"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "open."s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "the cafe"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "e-mail"s), vector<int>({2}));
+    ASSERT_EQUAL(FindIds(server, "3.14"s), vector<int>({2}));
+    ASSERT_EQUAL(FindIds(server, "caf*"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "cafe -OPEN"s), vector<int>());
+    // A word of punctuation only is dropped
+    ASSERT_EQUAL(FindIds(server, "cafe ..."s), vector<int>({1}));
+
+    SearchServer exact("The"s);
+    exact.AddDocument(1, "The Café"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(FindIds(exact, "café"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(exact, "cafe"s), vector<int>());
+}
+
+void TestPorterStem() {
+    // Pairs from the vocabulary and output of the reference implementation
+    const vector<pair<string, string>> reference = {
+        {"caresses"s, "caress"s}, {"ponies"s, "poni"s}, {"ties"s, "ti"s}, {"caress"s, "caress"s},
+        {"cats"s, "cat"s}, {"feed"s, "feed"s}, {"agreed"s, "agre"s}, {"plastered"s, "plaster"s},
+        {"bled"s, "bled"s}, {"motoring"s, "motor"s}, {"sing"s, "sing"s}, {"conflated"s, "conflat"s},
+        {"troubled"s, "troubl"s}, {"sized"s, "size"s}, {"hopping"s, "hop"s}, {"tanned"s, "tan"s},
+        {"falling"s, "fall"s}, {"hissing"s, "hiss"s}, {"fizzed"s, "fizz"s}, {"failing"s, "fail"s},
+        {"filing"s, "file"s}, {"happy"s, "happi"s}, {"sky"s, "sky"s}, {"relational"s, "relat"s},
+        {"conditional"s, "condit"s}, {"rational"s, "ration"s}, {"digitizer"s, "digit"s},
+        {"operator"s, "oper"s}, {"feudalism"s, "feudal"s}, {"decisiveness"s, "decis"s},
+        {"hopefulness"s, "hope"s}, {"callousness"s, "callous"s}, {"triplicate"s, "triplic"s},
+        {"formative"s, "form"s}, {"formalize"s, "formal"s}, {"electrical"s, "electr"s},
+        {"hopeful"s, "hope"s}, {"goodness"s, "good"s}, {"revival"s, "reviv"s}, {"allowance"s, "allow"s},
+        {"inference"s, "infer"s}, {"airliner"s, "airlin"s}, {"adjustable"s, "adjust"s},
+        {"defensible"s, "defens"s}, {"irritant"s, "irrit"s}, {"replacement"s, "replac"s},
+        {"adjustment"s, "adjust"s}, {"dependent"s, "depend"s}, {"adoption"s, "adopt"s},
+        {"communism"s, "commun"s}, {"activate"s, "activ"s}, {"effective"s, "effect"s},
+        {"bowdlerize"s, "bowdler"s}, {"probate"s, "probat"s}, {"rate"s, "rate"s}, {"cease"s, "ceas"s},
+        {"controlling"s, "control"s}, {"generalizations"s, "gener"s}, {"oscillators"s, "oscil"s},
+        {"connections"s, "connect"s}, {"connected"s, "connect"s}, {"connecting"s, "connect"s},
+        {"a"s, "a"s}, {"is"s, "is"s}, {""s, ""s},
+    };
+    for (const auto& [word, stem] : reference) {
+        ASSERT_EQUAL_HINT(PorterStem(word), stem, word);
+    }
+    // Anything but lowercase ASCII letters is left alone
+    ASSERT_EQUAL(PorterStem("Cats"s), "Cats"s);
+    ASSERT_EQUAL(PorterStem("e-mails"s), "e-mails"s);
+    ASSERT_EQUAL(PorterStem("cafés"s), "cafés"s);
+}
+
+void TestStemmedSearch() {
+    SearchServerOptions options;
+    options.stemmer = PorterStem;
+    SearchServer server("and"s, options);
+    server.AddDocument(1, "connected cats"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "connections and dogs"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(FindIds(server, "connecting"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "cat"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "connect -dog"s), vector<int>({1}));
+    ASSERT_EQUAL(FindIds(server, "+cats connection"s), vector<int>({1}));
+    // Patterns and fuzzy words match the stems, unstemmed
+    ASSERT_EQUAL(FindIds(server, "conn*"s), vector<int>({1, 2}));
+    ASSERT_EQUAL(FindIds(server, "dogs~0"s), vector<int>());
+    ASSERT_EQUAL(FindIds(server, "dogs~1"s), vector<int>({2}));
+}
+
+void TestRequestWindow() {
+    const SearchServer server = MakeAnimalServer();
+    {
+        RequestQueue request_queue(server);
+        ASSERT_EQUAL(request_queue.AddFindRequest("cat"s).size(), 2u);
+        ASSERT(request_queue.AddFindRequest("unknown"s).empty());
+        ASSERT(request_queue.AddFindRequest("dogs"s, DocumentStatus::ACTUAL).empty());
+        ASSERT_EQUAL(request_queue.GetRequestCount(), 3u);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+        ASSERT(IsNear(request_queue.GetNoResultRate(), 2.0 / 3));
+    }
+
+    // Requests stamped an hour ahead move the window there, so the counts
+    // do not depend on the clock while the test runs
+    RequestQueueOptions options;
+    options.bucket_width = chrono::minutes(1);
+    options.bucket_count = 3;
+    RequestQueue request_queue(server, options);
+    ASSERT(IsNear(request_queue.GetNoResultRate(), 0.0));
+    const RequestQueue::Clock::time_point start = RequestQueue::Clock::now() + chrono::hours(1);
+    const auto at_minute = [&start, &options](int minute) {
+        return start + options.bucket_width * minute;
+    };
+    request_queue.RecordRequest(false, at_minute(0));
+    request_queue.RecordRequest(true, at_minute(0));
+    request_queue.RecordRequest(false, at_minute(1));
+    request_queue.RecordRequest(true, at_minute(2));
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 4u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+
+    // The bucket of minute 0 leaves the window
+    request_queue.RecordRequest(false, at_minute(3));
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 3u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+    // Too late for the window
+    request_queue.RecordRequest(false, at_minute(0));
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 3u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+    // Not the newest bucket, but still in the window
+    request_queue.RecordRequest(false, at_minute(2));
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 3);
+
+    // A gap longer than the window retires every bucket
+    request_queue.RecordRequest(false, at_minute(10));
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 1u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+    ASSERT(IsNear(request_queue.GetNoResultRate(), 1.0));
+}
+
+// Reason of the RequestRejectedError thrown by the request, if any
+template <typename Request>
+optional<RejectReason> GetRejectReason(Request request) {
+    try {
+        request();
+    } catch (const RequestRejectedError& error) {
+        return error.GetReason();
+    }
+    return nullopt;
+}
+
+void TestRequestAdmission() {
+    const SearchServer server = MakeAnimalServer();
+    {
+        RequestQueueOptions options;
+        options.max_query_postings = 2;
+        RequestQueue request_queue(server, options);
+        // Exactly at the budget
+        ASSERT_EQUAL(request_queue.AddFindRequest("cat"s).size(), 2u);
+        // 2 postings of cat and 2 of groomed
+        ASSERT(GetRejectReason([&] { request_queue.AddFindRequest("cat groomed"s); }) == RejectReason::COST);
+        // Patterns are expanded before the cost is checked
+        ASSERT(GetRejectReason([&] { request_queue.AddFindRequest("c*"s); }) == RejectReason::COST);
+        ASSERT_EQUAL(request_queue.GetRejectedRequests(RejectReason::COST), 2u);
+        // Rejected requests are not counted in the window
+        ASSERT_EQUAL(request_queue.GetRequestCount(), 1u);
+    }
+    {
+        RequestQueueOptions options;
+        options.max_concurrent_requests = 1;
+        RequestQueue request_queue(server, options);
+        RequestOptions request_options;
+        request_options.deadline = RequestQueue::Clock::now() - chrono::seconds(1);
+        // Rejected even with a free slot
+        ASSERT(GetRejectReason([&] { request_queue.AddFindRequest("cat"s, request_options); }) == RejectReason::DEADLINE);
+        ASSERT_EQUAL(request_queue.GetRejectedRequests(RejectReason::DEADLINE), 1u);
+        ASSERT_EQUAL(request_queue.GetRequestCount(), 0u);
+        ASSERT_EQUAL(request_queue.AddFindRequest("cat"s).size(), 2u);
+    }
+}
+
+void TestRequestDegradation() {
+    const SearchServer server = MakeAnimalServer();
+    RequestQueueOptions options;
+    options.max_concurrent_requests = 1;
+    options.max_queued_requests = 2;
+    options.degrade_queue_depth = 1;
+    options.degraded_postings_per_term = 1;
+    RequestQueue request_queue(server, options);
+    const auto wait_for = [](const auto& condition) {
+        while (!condition()) {
+            this_thread::yield();
+        }
+    };
+
+    // The first request holds the only slot until released
+    promise<void> release;
+    const shared_future<void> released = release.get_future().share();
+    atomic<bool> is_running = false;
+    vector<Document> first;
+    thread first_thread([&] {
+        first = request_queue.AddFindRequest("cat"s, [&](int, DocumentStatus status, int) {
+            is_running = true;
+            released.wait();
+            return status == DocumentStatus::ACTUAL;
+        });
+    });
+    wait_for([&] { return is_running.load(); });
+
+    vector<Document> second;
+    thread second_thread([&] {
+        second = request_queue.AddFindRequest("cat"s);
+    });
+    wait_for([&] { return request_queue.GetWaitingRequests() == 1; });
+    vector<Document> third;
+    thread third_thread([&] {
+        third = request_queue.AddFindRequest("cat"s);
+    });
+    wait_for([&] { return request_queue.GetWaitingRequests() == 2; });
+
+    // No waiter of lower priority to displace
+    ASSERT(GetRejectReason([&] { request_queue.AddFindRequest("cat"s); }) == RejectReason::QUEUE_FULL);
+
+    release.set_value();
+    first_thread.join();
+    second_thread.join();
+    third_thread.join();
+    // The second request was admitted with the third still waiting, so it
+    // scored only the first posting of cat; the third found both documents
+    ASSERT_EQUAL(first.size(), 2u);
+    ASSERT_EQUAL(second.size(), 1u);
+    ASSERT_EQUAL(second[0].id, 1);
+    ASSERT_EQUAL(third.size(), 2u);
+    ASSERT_EQUAL(request_queue.GetDegradedRequests(), 1u);
+    ASSERT_EQUAL(request_queue.GetRejectedRequests(RejectReason::QUEUE_FULL), 1u);
+    ASSERT_EQUAL(request_queue.GetWaitingRequests(), 0u);
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 3u);
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestCompact);
+    RUN_TEST(TestFindDuplicates);
+    RUN_TEST(TestFindNearDuplicates);
+    RUN_TEST(TestDuplicatePolicy);
+    RUN_TEST(TestBm25);
+    RUN_TEST(TestBm25Plus);
+    RUN_TEST(TestScoreKernels);
+    RUN_TEST(TestScoreAccumulator);
+    RUN_TEST(TestParallelRanking);
+    RUN_TEST(TestPhrases);
+    RUN_TEST(TestProximity);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestMatchesWildcard);
+    RUN_TEST(TestPatterns);
+    RUN_TEST(TestFuzzyWords);
+    RUN_TEST(TestMatchDocument);
+    RUN_TEST(TestNormalization);
+    RUN_TEST(TestPorterStem);
+    RUN_TEST(TestStemmedSearch);
+    RUN_TEST(TestRequestWindow);
+    RUN_TEST(TestRequestAdmission);
+    RUN_TEST(TestRequestDegradation);
+}
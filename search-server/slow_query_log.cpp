@@ -0,0 +1,188 @@
+#include "slow_query_log.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory_resource>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "string_processing.h"
+#include "text_normalization.h"
+#include "word_hash.h"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+// Tabs and line breaks of the query would break the line format
+std::string EscapeField(std::string_view text) {
+    std::string result(text);
+    std::replace_if(result.begin(), result.end(), [](char c) {
+        return c == '\t' || c == '\n' || c == '\r';
+    }, ' ');
+    return result;
+}
+
+}  // namespace
+
+SlowQueryLog::SlowQueryLog(const SlowQueryLogOptions& options)
+    : options_(options)
+    , mask_(RoundUpToPowerOfTwo(std::max<size_t>(options.capacity, 2)) - 1)
+    , slots_(std::make_unique<Slot[]>(mask_ + 1))
+    , file_(options.path, std::ios::binary | std::ios::app) {
+    if (!file_) {
+        throw std::runtime_error("Cannot open "s + options.path);
+    }
+    if (options.sample_rate < 0.0 || options.sample_rate > 1.0) {
+        throw std::invalid_argument("Sample rate must be in [0, 1]"s);
+    }
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    flusher_ = std::thread([this] {
+        std::unique_lock lock(flusher_mutex_);
+        while (!stopping_) {
+            flusher_wakeup_.wait_for(lock, options_.flush_interval, [this] {
+                return stopping_;
+            });
+            lock.unlock();
+            Flush();
+            lock.lock();
+        }
+    });
+}
+
+SlowQueryLog::~SlowQueryLog() {
+    {
+        std::lock_guard lock(flusher_mutex_);
+        stopping_ = true;
+    }
+    flusher_wakeup_.notify_one();
+    flusher_.join();
+    Flush();
+}
+
+std::optional<SlowQueryReason> SlowQueryLog::Classify(std::chrono::nanoseconds latency) const {
+    if (latency >= options_.threshold) {
+        return SlowQueryReason::SLOW;
+    }
+    if (options_.sample_rate > 0.0) {
+        thread_local std::minstd_rand random(std::random_device{}());
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(random) < options_.sample_rate) {
+            return SlowQueryReason::SAMPLED;
+        }
+    }
+    return std::nullopt;
+}
+
+bool SlowQueryLog::Record(SlowQueryEntry&& entry) {
+    // Bounded multi-producer queue of Dmitry Vyukov: a producer claims a
+    // position with one CAS and publishes the entry through the slot sequence
+    size_t position = push_position_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[position & mask_];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+            if (push_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            dropped_count_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = push_position_.load(std::memory_order_relaxed);
+        }
+    }
+    slot->entry = std::move(entry);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool SlowQueryLog::TryPop(SlowQueryEntry& entry) {
+    size_t position = pop_position_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[position & mask_];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+        if (difference == 0) {
+            if (pop_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = pop_position_.load(std::memory_order_relaxed);
+        }
+    }
+    entry = std::move(slot->entry);
+    slot->sequence.store(position + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+void SlowQueryLog::Flush() {
+    std::lock_guard lock(file_mutex_);
+    SlowQueryEntry entry;
+    while (TryPop(entry)) {
+        WriteEntry(entry);
+        logged_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    file_.flush();
+}
+
+uint64_t SlowQueryLog::GetLoggedCount() const {
+    return logged_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t SlowQueryLog::GetDroppedCount() const {
+    return dropped_count_.load(std::memory_order_relaxed);
+}
+
+std::string SlowQueryLog::NormalizeQuery(std::string_view raw_query) {
+    std::pmr::monotonic_buffer_resource scratch;
+    std::vector<std::string_view> words;
+    for (const std::string_view word : SplitIntoWords(raw_query)) {
+        // Operators and phrase quotes are part of the shape of the query
+        const std::string_view normalized = NormalizeWord(word, NormalizationOptions{}, "-+*?~\""sv, &scratch);
+        if (!normalized.empty()) {
+            words.push_back(normalized);
+        }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    std::string result;
+    for (const std::string_view word : words) {
+        if (!result.empty()) {
+            result += ' ';
+        }
+        result += word;
+    }
+    return result;
+}
+
+uint64_t SlowQueryLog::FingerprintQuery(std::string_view raw_query) {
+    return HashWord(NormalizeQuery(raw_query));
+}
+
+void SlowQueryLog::WriteEntry(const SlowQueryEntry& entry) {
+    const std::string normalized = NormalizeQuery(entry.query);
+    const auto time = std::chrono::duration_cast<std::chrono::milliseconds>(entry.time.time_since_epoch()).count();
+    file_ << time << '\t'
+          << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::micro>(entry.latency).count() << '\t'
+          << (entry.reason == SlowQueryReason::SLOW ? "SLOW"sv : "SAMPLED"sv) << '\t'
+          << std::hex << std::setw(16) << std::setfill('0') << HashWord(normalized) << std::dec << std::setfill(' ') << '\t'
+          << entry.term_count << '\t' << entry.posting_count << '\t' << entry.result_count << '\t'
+          << EscapeField(normalized) << '\t' << EscapeField(entry.query) << '\n';
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Why a query was logged
+enum class SlowQueryReason {
+    SLOW,
+    SAMPLED,
+};
+
+struct SlowQueryLogOptions {
+    // Lines are appended to the file
+    std::string path;
+    // Queries running at least this long are always logged
+    std::chrono::nanoseconds threshold = std::chrono::milliseconds(100);
+    // Share of the faster queries logged anyway, to compare the slow ones with
+    double sample_rate = 0.0;
+    // Entries waiting to be written; queries arriving when it is full are dropped
+    size_t capacity = 4096;
+    std::chrono::milliseconds flush_interval{1000};
+};
+
+struct SlowQueryEntry {
+    std::chrono::system_clock::time_point time;
+    std::chrono::nanoseconds latency{};
+    SlowQueryReason reason = SlowQueryReason::SLOW;
+    std::string query;
+    // Query words and their posting list lengths, including pattern expansions and minus words
+    size_t term_count = 0;
+    size_t posting_count = 0;
+    size_t result_count = 0;
+};
+
+// Log of slow and sampled queries, one line per query:
+//     <unix time ms>\t<latency us>\t<SLOW|SAMPLED>\t<fingerprint>\t<terms>\t<postings>\t<results>\t<normalized query>\t<query>
+// Queries that differ only in case, word order and repeats share the
+// fingerprint, so the lines can be grouped by it.
+//
+// Searching threads only decide whether a query is logged, which costs a
+// comparison, and push the entry into a bounded lock-free queue. A background
+// thread normalizes the queries and writes the file.
+class SlowQueryLog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SlowQueryLog(const SlowQueryLogOptions& options);
+
+    SlowQueryLog(const SlowQueryLog&) = delete;
+    SlowQueryLog& operator=(const SlowQueryLog&) = delete;
+
+    // Writes the remaining entries
+    ~SlowQueryLog();
+
+    // Whether a query of this latency is to be logged
+    std::optional<SlowQueryReason> Classify(std::chrono::nanoseconds latency) const;
+
+    // Returns false if the queue is full and the entry was dropped
+    bool Record(SlowQueryEntry&& entry);
+
+    // Writes the queued entries now
+    void Flush();
+
+    uint64_t GetLoggedCount() const;
+
+    uint64_t GetDroppedCount() const;
+
+    // Lowercased query words with their operators, sorted and deduplicated
+    static std::string NormalizeQuery(std::string_view raw_query);
+
+    static uint64_t FingerprintQuery(std::string_view raw_query);
+
+private:
+    struct Slot {
+        // Equal to the position of the next push into the slot while it is free,
+        // to that position + 1 while it holds an entry
+        std::atomic<size_t> sequence;
+        SlowQueryEntry entry;
+    };
+
+    const SlowQueryLogOptions options_;
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> push_position_{0};
+    alignas(64) std::atomic<size_t> pop_position_{0};
+    std::atomic<uint64_t> logged_count_{0};
+    std::atomic<uint64_t> dropped_count_{0};
+
+    std::mutex file_mutex_;
+    std::ofstream file_;
+
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_wakeup_;
+    bool stopping_ = false;
+    std::thread flusher_;
+
+    bool TryPop(SlowQueryEntry& entry);
+
+    void WriteEntry(const SlowQueryEntry& entry);
+};
@@ -0,0 +1,270 @@
+#include "stemming.h"
+
+#include <algorithm>
+
+#include "word_hash.h"
+
+namespace {
+
+// Follows the reference implementation by Martin Porter: the word is kept in
+// b[0..k], and j marks the end of the stem once a suffix has matched
+class PorterStemmer {
+public:
+    explicit PorterStemmer(std::string_view word)
+        : b_(word)
+        , k_(static_cast<int>(word.size()) - 1) {
+    }
+
+    std::string Stem() {
+        if (k_ > 1) {
+            Step1ab();
+            if (k_ > 0) {
+                Step1c();
+                Step2();
+                Step3();
+                Step4();
+                Step5();
+            }
+        }
+        b_.resize(k_ + 1);
+        return std::move(b_);
+    }
+
+private:
+    std::string b_;
+    int k_;
+    int j_ = 0;
+
+    bool IsConsonant(int i) const {
+        switch (b_[i]) {
+        case 'a': case 'e': case 'i': case 'o': case 'u':
+            return false;
+        case 'y':
+            return i == 0 || !IsConsonant(i - 1);
+        default:
+            return true;
+        }
+    }
+
+    // Number of vowel-consonant sequences in b[0..j]
+    int Measure() const {
+        int n = 0;
+        int i = 0;
+        while (i <= j_ && IsConsonant(i)) {
+            ++i;
+        }
+        while (i <= j_) {
+            while (i <= j_ && !IsConsonant(i)) {
+                ++i;
+            }
+            if (i > j_) {
+                break;
+            }
+            ++n;
+            while (i <= j_ && IsConsonant(i)) {
+                ++i;
+            }
+        }
+        return n;
+    }
+
+    bool HasVowelInStem() const {
+        for (int i = 0; i <= j_; ++i) {
+            if (!IsConsonant(i)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool EndsWithDoubleConsonant(int i) const {
+        return i >= 1 && b_[i] == b_[i - 1] && IsConsonant(i);
+    }
+
+    // consonant-vowel-consonant ending at i, where the last consonant is not w, x or y
+    bool EndsWithCvc(int i) const {
+        if (i < 2 || !IsConsonant(i) || IsConsonant(i - 1) || !IsConsonant(i - 2)) {
+            return false;
+        }
+        return b_[i] != 'w' && b_[i] != 'x' && b_[i] != 'y';
+    }
+
+    bool Ends(std::string_view suffix) {
+        const int length = static_cast<int>(suffix.size());
+        if (length > k_ + 1 || std::string_view(b_).substr(k_ + 1 - length, length) != suffix) {
+            return false;
+        }
+        j_ = k_ - length;
+        return true;
+    }
+
+    void SetTo(std::string_view suffix) {
+        b_.replace(j_ + 1, k_ - j_, suffix);
+        k_ = j_ + static_cast<int>(suffix.size());
+    }
+
+    void ReplaceIfMeasured(std::string_view suffix) {
+        if (Measure() > 0) {
+            SetTo(suffix);
+        }
+    }
+
+    // Plurals and -ed or -ing
+    void Step1ab() {
+        if (b_[k_] == 's') {
+            if (Ends("sses")) {
+                k_ -= 2;
+            } else if (Ends("ies")) {
+                SetTo("i");
+            } else if (b_[k_ - 1] != 's') {
+                --k_;
+            }
+        }
+        if (Ends("eed")) {
+            if (Measure() > 0) {
+                --k_;
+            }
+        } else if ((Ends("ed") || Ends("ing")) && HasVowelInStem()) {
+            k_ = j_;
+            if (Ends("at")) {
+                SetTo("ate");
+            } else if (Ends("bl")) {
+                SetTo("ble");
+            } else if (Ends("iz")) {
+                SetTo("ize");
+            } else if (EndsWithDoubleConsonant(k_)) {
+                --k_;
+                if (b_[k_] == 'l' || b_[k_] == 's' || b_[k_] == 'z') {
+                    ++k_;
+                }
+            } else {
+                j_ = k_;
+                if (Measure() == 1 && EndsWithCvc(k_)) {
+                    SetTo("e");
+                }
+            }
+        }
+    }
+
+    // Terminal y to i when there is another vowel in the stem
+    void Step1c() {
+        if (Ends("y") && HasVowelInStem()) {
+            b_[k_] = 'i';
+        }
+    }
+
+    // Double suffixes to single ones: -ization to -ize and so on
+    void Step2() {
+        static constexpr std::pair<std::string_view, std::string_view> RULES[] = {
+            {"ational", "ate"}, {"tional", "tion"}, {"enci", "ence"}, {"anci", "ance"}, {"izer", "ize"},
+            {"bli", "ble"}, {"alli", "al"}, {"entli", "ent"}, {"eli", "e"}, {"ousli", "ous"},
+            {"ization", "ize"}, {"ation", "ate"}, {"ator", "ate"}, {"alism", "al"}, {"iveness", "ive"},
+            {"fulness", "ful"}, {"ousness", "ous"}, {"aliti", "al"}, {"iviti", "ive"}, {"biliti", "ble"},
+            {"logi", "log"},
+        };
+        ApplyFirstRule(RULES);
+    }
+
+    // -ic-, -full, -ness and so on
+    void Step3() {
+        static constexpr std::pair<std::string_view, std::string_view> RULES[] = {
+            {"icate", "ic"}, {"ative", ""}, {"alize", "al"}, {"iciti", "ic"}, {"ical", "ic"}, {"ful", ""}, {"ness", ""},
+        };
+        ApplyFirstRule(RULES);
+    }
+
+    // -ant, -ence and so on, when the stem has at least two syllables
+    void Step4() {
+        static constexpr std::string_view SUFFIXES[] = {
+            "al", "ance", "ence", "er", "ic", "able", "ible", "ant", "ement", "ment", "ent",
+            "ou", "ism", "ate", "iti", "ous", "ive", "ize",
+        };
+        bool matched = std::any_of(std::begin(SUFFIXES), std::end(SUFFIXES), [this](std::string_view suffix) {
+            return Ends(suffix);
+        });
+        if (!matched && Ends("ion")) {
+            matched = j_ >= 0 && (b_[j_] == 's' || b_[j_] == 't');
+        }
+        if (matched && Measure() > 1) {
+            k_ = j_;
+        }
+    }
+
+    // Final -e and -ll
+    void Step5() {
+        j_ = k_;
+        if (b_[k_] == 'e') {
+            const int measure = Measure();
+            if (measure > 1 || (measure == 1 && !EndsWithCvc(k_ - 1))) {
+                --k_;
+            }
+        }
+        if (b_[k_] == 'l' && EndsWithDoubleConsonant(k_) && Measure() > 1) {
+            --k_;
+        }
+    }
+
+    // The reference implementation tries the suffixes of a step in a fixed
+    // order and stops at the first one the word ends with
+    template <size_t N>
+    void ApplyFirstRule(const std::pair<std::string_view, std::string_view> (&rules)[N]) {
+        for (const auto& [suffix, replacement] : rules) {
+            if (Ends(suffix)) {
+                ReplaceIfMeasured(replacement);
+                return;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+std::string PorterStem(std::string_view word) {
+    if (!std::all_of(word.begin(), word.end(), [](char c) { return c >= 'a' && c <= 'z'; })) {
+        return std::string(word);
+    }
+    return PorterStemmer(word).Stem();
+}
+
+StemCache::StemCache(Stemmer stemmer, size_t capacity)
+    : stemmer_(std::move(stemmer))
+    , shard_capacity_(std::max<size_t>(capacity / SHARD_COUNT, 1)) {
+}
+
+std::string_view StemCache::Stem(std::string_view word, std::pmr::memory_resource* resource, bool* cache_hit) {
+    // The cached stem may be evicted by another thread, so it is copied out
+    const auto copy_stem = [word, resource](const std::string& stem) -> std::string_view {
+        if (stem == word) {
+            return word;
+        }
+        char* const data = static_cast<char*>(resource->allocate(stem.size() + 1, 1));
+        std::copy(stem.begin(), stem.end(), data);
+        return {data, stem.size()};
+    };
+
+    const uint64_t hash = HashWord(word);
+    Shard& shard = shards_[hash % SHARD_COUNT];
+    {
+        std::lock_guard guard(shard.mutex);
+        const auto entry = shard.stems.find(hash);
+        if (entry != shard.stems.end() && entry->second.first == word) {
+            if (cache_hit) {
+                *cache_hit = true;
+            }
+            return copy_stem(entry->second.second);
+        }
+    }
+    if (cache_hit) {
+        *cache_hit = false;
+    }
+
+    std::string stem = stemmer_(word);
+    const std::string_view result = copy_stem(stem);
+    std::lock_guard guard(shard.mutex);
+    // Dropping a full shard at once keeps the cache bounded without bookkeeping
+    if (shard.stems.size() >= shard_capacity_) {
+        shard.stems.clear();
+    }
+    shard.stems.insert_or_assign(hash, std::make_pair(std::string(word), std::move(stem)));
+    return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Maps a normalized word to the term indexed for it, e.g. cats and cat to cat
+using Stemmer = std::function<std::string(std::string_view word)>;
+
+// The Porter (1980) suffix-stripping algorithm for English. Words with anything
+// but lowercase ASCII letters are returned unchanged.
+std::string PorterStem(std::string_view word);
+
+// Remembers the stems of recently seen words, so repeated words call the
+// stemmer once. Thread-safe; words are spread over shards with a lock each.
+class StemCache {
+public:
+    StemCache(Stemmer stemmer, size_t capacity);
+
+    // Returns the word itself if it is its own stem, otherwise the stem
+    // allocated from the resource. Tells in cache_hit whether the stemmer was skipped.
+    std::string_view Stem(std::string_view word, std::pmr::memory_resource* resource, bool* cache_hit = nullptr);
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        // Hash of the word -> (word, stem)
+        std::unordered_map<uint64_t, std::pair<std::string, std::string>> stems;
+    };
+
+    Stemmer stemmer_;
+    size_t shard_capacity_;
+    std::array<Shard, SHARD_COUNT> shards_;
+};
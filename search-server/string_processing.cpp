@@ -1,8 +1,11 @@
 #include "string_processing.h"
 
-std::vector<std::string_view> SplitIntoWords(const std::string_view str) {
-    std::vector<std::string_view> result;
+using namespace std::string_view_literals;
 
+namespace {
+
+template <typename Container>
+void SplitIntoWords(const std::string_view str, Container& result) {
     int64_t pos = str.find_first_not_of(" ");
 
     const int64_t pos_end = str.npos;
@@ -12,6 +15,48 @@ std::vector<std::string_view> SplitIntoWords(const std::string_view str) {
         result.push_back(space == pos_end ? str.substr(pos) : str.substr(pos, space - pos));
         pos = str.find_first_not_of(" ", space);
     }
+}
+
+}  // namespace
+
+std::vector<std::string_view> SplitIntoWords(const std::string_view str) {
+    std::vector<std::string_view> result;
+    SplitIntoWords(str, result);
+    return result;
+}
 
+std::pmr::vector<std::string_view> SplitIntoWords(const std::string_view str, std::pmr::memory_resource* resource) {
+    std::pmr::vector<std::string_view> result(resource);
+    SplitIntoWords(str, result);
     return result;
 }
+
+bool IsWildcardPattern(const std::string_view word) {
+    return word.find_first_of("*?"sv) != word.npos;
+}
+
+bool MatchesWildcard(const std::string_view pattern, const std::string_view word) {
+    // Greedy matching: on a mismatch the last * absorbs one more character
+    size_t pattern_pos = 0;
+    size_t word_pos = 0;
+    size_t star_pos = pattern.npos;
+    size_t star_word_pos = 0;
+    while (word_pos < word.size()) {
+        if (pattern_pos < pattern.size() && (pattern[pattern_pos] == '?' || pattern[pattern_pos] == word[word_pos])) {
+            ++pattern_pos;
+            ++word_pos;
+        } else if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+            star_pos = pattern_pos++;
+            star_word_pos = word_pos;
+        } else if (star_pos != pattern.npos) {
+            pattern_pos = star_pos + 1;
+            word_pos = ++star_word_pos;
+        } else {
+            return false;
+        }
+    }
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+        ++pattern_pos;
+    }
+    return pattern_pos == pattern.size();
+}
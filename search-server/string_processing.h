@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include <set>
@@ -7,6 +8,13 @@
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view str);
 
+std::pmr::vector<std::string_view> SplitIntoWords(const std::string_view str, std::pmr::memory_resource* resource);
+
+// Whether the word contains the wildcards * (any characters) or ? (one character)
+bool IsWildcardPattern(const std::string_view word);
+
+bool MatchesWildcard(const std::string_view pattern, const std::string_view word);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -0,0 +1,124 @@
+#include "synthetic_corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "word_hash.h"
+
+using namespace std::string_literals;
+
+ZipfDistribution::ZipfDistribution(size_t size, double exponent) {
+    if (size == 0) {
+        throw std::invalid_argument("Zipf distribution needs at least one rank"s);
+    }
+    cumulative_.reserve(size);
+    double sum = 0.0;
+    for (size_t rank = 1; rank <= size; ++rank) {
+        sum += 1.0 / std::pow(static_cast<double>(rank), exponent);
+        cumulative_.push_back(sum);
+    }
+    for (double& value : cumulative_) {
+        value /= sum;
+    }
+}
+
+size_t ZipfDistribution::operator()(std::mt19937_64& random) const {
+    const double point = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+    const auto rank = std::lower_bound(cumulative_.begin(), cumulative_.end(), point);
+    return std::min<size_t>(rank - cumulative_.begin(), cumulative_.size() - 1);
+}
+
+SyntheticCorpus::SyntheticCorpus(const SyntheticCorpusOptions& options)
+    : options_(options)
+    , word_ranks_(options.vocabulary_size, options.zipf_exponent) {
+    if (options.stop_word_density > 0.0 && options.stop_words.empty()) {
+        throw std::invalid_argument("Stop word density needs stop words"s);
+    }
+    if (options.min_rating > options.max_rating) {
+        throw std::invalid_argument("Rating range is empty"s);
+    }
+    // Frequent words are short, as in natural languages
+    std::mt19937_64 random = MakeRandom(0);
+    std::unordered_set<std::string> used;
+    vocabulary_.reserve(options.vocabulary_size);
+    while (vocabulary_.size() < options.vocabulary_size) {
+        const size_t base_length = 2 + static_cast<size_t>(std::log2(vocabulary_.size() + 2.0) / 2);
+        const size_t length = base_length + random() % 3;
+        std::string word(length, 'a');
+        for (char& c : word) {
+            c = static_cast<char>('a' + random() % 26);
+        }
+        if (used.insert(word).second) {
+            vocabulary_.push_back(std::move(word));
+        }
+    }
+}
+
+const std::vector<std::string>& SyntheticCorpus::GetVocabulary() const {
+    return vocabulary_;
+}
+
+std::string SyntheticCorpus::MakeDocument(std::mt19937_64& random) const {
+    const size_t length = MakeDocumentLength(random);
+    std::string document;
+    for (size_t i = 0; i < length; ++i) {
+        if (i > 0) {
+            document += ' ';
+        }
+        document += MakeWord(random);
+    }
+    return document;
+}
+
+DocumentStatus SyntheticCorpus::MakeStatus(std::mt19937_64& random) const {
+    std::discrete_distribution<int> status(options_.status_weights.begin(), options_.status_weights.end());
+    return static_cast<DocumentStatus>(status(random));
+}
+
+std::vector<int> SyntheticCorpus::MakeRatings(std::mt19937_64& random) const {
+    std::uniform_int_distribution<int> rating(options_.min_rating, options_.max_rating);
+    std::vector<int> ratings(options_.ratings_per_document);
+    for (int& value : ratings) {
+        value = rating(random);
+    }
+    return ratings;
+}
+
+std::string SyntheticCorpus::MakeQuery(std::mt19937_64& random, size_t word_count, double minus_ratio) const {
+    std::bernoulli_distribution is_minus(minus_ratio);
+    std::string query;
+    for (size_t i = 0; i < word_count; ++i) {
+        if (i > 0) {
+            query += ' ';
+        }
+        if (is_minus(random)) {
+            query += '-';
+        }
+        query += MakeWord(random);
+    }
+    return query;
+}
+
+std::mt19937_64 SyntheticCorpus::MakeRandom(uint64_t stream) const {
+    return std::mt19937_64(MixHash(options_.seed ^ MixHash(stream + 1)));
+}
+
+size_t SyntheticCorpus::MakeDocumentLength(std::mt19937_64& random) const {
+    const size_t average = std::max<size_t>(options_.average_document_length, 1);
+    if (options_.length_distribution == DocumentLengthDistribution::LOG_NORMAL) {
+        // The mean of a log-normal distribution is exp(mu + sigma^2 / 2)
+        const double sigma = 0.8;
+        std::lognormal_distribution<double> length(std::log(static_cast<double>(average)) - sigma * sigma / 2, sigma);
+        return std::max<size_t>(static_cast<size_t>(std::llround(length(random))), 1);
+    }
+    return std::uniform_int_distribution<size_t>(average - average / 2, average + average / 2)(random);
+}
+
+const std::string& SyntheticCorpus::MakeWord(std::mt19937_64& random) const {
+    if (options_.stop_word_density > 0.0 && std::bernoulli_distribution(options_.stop_word_density)(random)) {
+        return options_.stop_words[random() % options_.stop_words.size()];
+    }
+    return vocabulary_[word_ranks_(random)];
+}
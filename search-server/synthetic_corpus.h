@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+// Reproducible synthetic workloads: words are drawn from a fixed vocabulary by
+// a Zipf law, as in natural text, and everything is derived from the seed.
+
+enum class DocumentLengthDistribution {
+    // Lengths spread evenly over [average / 2, 3 * average / 2]
+    UNIFORM,
+    // Mostly short documents with a long tail of long ones
+    LOG_NORMAL,
+};
+
+struct SyntheticCorpusOptions {
+    size_t vocabulary_size = 50'000;
+    // Probability of the word of rank r is proportional to 1 / r^zipf_exponent
+    double zipf_exponent = 1.0;
+    size_t average_document_length = 20;
+    DocumentLengthDistribution length_distribution = DocumentLengthDistribution::UNIFORM;
+    // Share of document and query words taken evenly from stop_words instead
+    // of the vocabulary
+    double stop_word_density = 0.0;
+    std::vector<std::string> stop_words;
+    // Relative frequencies of ACTUAL, IRRELEVANT, BANNED and REMOVED documents
+    std::array<double, 4> status_weights = {1.0, 0.0, 0.0, 0.0};
+    size_t ratings_per_document = 3;
+    int min_rating = -10;
+    int max_rating = 10;
+    uint64_t seed = 42;
+};
+
+// Samples ranks in [0, size) with the inverse of the cumulative distribution
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double exponent);
+
+    size_t operator()(std::mt19937_64& random) const;
+
+private:
+    std::vector<double> cumulative_;
+};
+
+class SyntheticCorpus {
+public:
+    explicit SyntheticCorpus(const SyntheticCorpusOptions& options);
+
+    // Words ordered by rank, the most frequent first
+    const std::vector<std::string>& GetVocabulary() const;
+
+    // Document of a random length around the average
+    std::string MakeDocument(std::mt19937_64& random) const;
+
+    DocumentStatus MakeStatus(std::mt19937_64& random) const;
+
+    std::vector<int> MakeRatings(std::mt19937_64& random) const;
+
+    // Query of word_count words, each a minus word with probability minus_ratio
+    std::string MakeQuery(std::mt19937_64& random, size_t word_count, double minus_ratio = 0.0) const;
+
+    // A generator seeded from the corpus seed and stream, so independent
+    // streams of documents and queries do not depend on each other
+    std::mt19937_64 MakeRandom(uint64_t stream) const;
+
+private:
+    SyntheticCorpusOptions options_;
+    std::vector<std::string> vocabulary_;
+    ZipfDistribution word_ranks_;
+
+    size_t MakeDocumentLength(std::mt19937_64& random) const;
+
+    const std::string& MakeWord(std::mt19937_64& random) const;
+};
@@ -0,0 +1,306 @@
+#include "text_normalization.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum class ByteClass : unsigned char {
+    PLAIN,        // a-z, 0-9
+    UPPER,        // A-Z
+    PUNCTUATION,  // printable ASCII that is neither a letter nor a digit
+    OTHER,        // space and control characters
+    NON_ASCII,
+};
+
+constexpr std::array<ByteClass, 256> MakeByteClasses() {
+    std::array<ByteClass, 256> classes{};
+    for (int c = 0; c < 256; ++c) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            classes[c] = ByteClass::PLAIN;
+        } else if (c >= 'A' && c <= 'Z') {
+            classes[c] = ByteClass::UPPER;
+        } else if (c > ' ' && c < 0x7F) {
+            classes[c] = ByteClass::PUNCTUATION;
+        } else if (c < 0x80) {
+            classes[c] = ByteClass::OTHER;
+        } else {
+            classes[c] = ByteClass::NON_ASCII;
+        }
+    }
+    return classes;
+}
+
+constexpr std::array<ByteClass, 256> BYTE_CLASSES = MakeByteClasses();
+
+ByteClass GetByteClass(char c) {
+    return BYTE_CLASSES[static_cast<unsigned char>(c)];
+}
+
+// Bytes that are not part of a valid UTF-8 sequence are decoded to
+// RAW_BYTE + byte and encoded back unchanged
+constexpr char32_t RAW_BYTE = 0x110000;
+
+// Base letters of U+00C0..U+017F: * marks a character without one, # a letter
+// written with two base letters
+constexpr std::string_view BASE_LETTERS =
+    "AAAAAA#CEEEEIIIIDNOOOOO*OUUUUY##"
+    "aaaaaa#ceeeeiiiidnooooo*ouuuuy#y"
+    "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGgGgGgHhHhIiIiIiIiIi##JjKkkLlLlLlLlLlNnNnNnnNnOoOoOo##RrRrRrSsSsSsSsTtTtTtUuUuUuUuUuUuWwYyYZzZzZzs";
+
+static_assert(BASE_LETTERS.size() == 0x180 - 0xC0);
+
+char32_t DecodeCodePoint(const std::string_view text, size_t& pos) {
+    const auto byte = [text](size_t index) {
+        return index < text.size() ? static_cast<unsigned char>(text[index]) : 0;
+    };
+    const unsigned char lead = byte(pos);
+    if (lead < 0x80) {
+        ++pos;
+        return lead;
+    }
+    size_t length = 0;
+    char32_t value = 0;
+    unsigned char min_next = 0x80;
+    unsigned char max_next = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        value = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        value = lead & 0x0F;
+        // Overlong forms and UTF-16 surrogates are invalid
+        min_next = lead == 0xE0 ? 0xA0 : 0x80;
+        max_next = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        value = lead & 0x07;
+        min_next = lead == 0xF0 ? 0x90 : 0x80;
+        max_next = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        ++pos;
+        return RAW_BYTE + lead;
+    }
+    for (size_t i = 1; i < length; ++i) {
+        const unsigned char next = byte(pos + i);
+        if (next < (i == 1 ? min_next : 0x80) || next > (i == 1 ? max_next : 0xBF)) {
+            ++pos;
+            return RAW_BYTE + lead;
+        }
+        value = (value << 6) | (next & 0x3F);
+    }
+    pos += length;
+    return value;
+}
+
+void AppendCodePoint(std::pmr::string& text, char32_t value) {
+    if (value >= RAW_BYTE) {
+        text.push_back(static_cast<char>(value - RAW_BYTE));
+    } else if (value < 0x80) {
+        text.push_back(static_cast<char>(value));
+    } else if (value < 0x800) {
+        text.push_back(static_cast<char>(0xC0 | (value >> 6)));
+        text.push_back(static_cast<char>(0x80 | (value & 0x3F)));
+    } else if (value < 0x10000) {
+        text.push_back(static_cast<char>(0xE0 | (value >> 12)));
+        text.push_back(static_cast<char>(0x80 | ((value >> 6) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | (value & 0x3F)));
+    } else {
+        text.push_back(static_cast<char>(0xF0 | (value >> 18)));
+        text.push_back(static_cast<char>(0x80 | ((value >> 12) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | ((value >> 6) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | (value & 0x3F)));
+    }
+}
+
+bool IsPunctuation(char32_t value, const std::string_view keep) {
+    if (value < 0x80) {
+        return GetByteClass(static_cast<char>(value)) == ByteClass::PUNCTUATION && keep.find(static_cast<char>(value)) == keep.npos;
+    }
+    if (value >= 0xA0 && value <= 0xBF) {
+        // ª ² ³ µ ¹ º ¼ ½ ¾ are letters and numbers
+        return value != 0xAA && value != 0xB2 && value != 0xB3 && value != 0xB5 && value != 0xB9 && value != 0xBA
+            && (value < 0xBC || value > 0xBE);
+    }
+    return value == 0xD7 || value == 0xF7
+        || (value >= 0x2000 && value <= 0x206F)   // general punctuation
+        || (value >= 0x20A0 && value <= 0x20CF)   // currency symbols
+        || (value >= 0x2E00 && value <= 0x2E7F)   // supplemental punctuation
+        || (value >= 0x3000 && value <= 0x303F);  // CJK punctuation
+}
+
+char32_t FoldCase(char32_t value) {
+    if (value < 0x80) {
+        return value >= 'A' && value <= 'Z' ? value + ('a' - 'A') : value;
+    }
+    if (value >= 0xC0 && value <= 0xDE && value != 0xD7) {
+        return value + 0x20;
+    }
+    if (value >= 0x100 && value <= 0x17F) {
+        // Latin Extended-A alternates upper and lower case letters
+        if (value == 0x130) {
+            return 'i';
+        }
+        if (value == 0x178) {
+            return 0xFF;
+        }
+        if (value == 0x17F) {
+            return 's';
+        }
+        const bool upper_is_even = value <= 0x137 || (value >= 0x14A && value <= 0x177);
+        const bool upper_is_odd = (value >= 0x139 && value <= 0x148) || (value >= 0x179 && value <= 0x17E);
+        if ((upper_is_even && value % 2 == 0) || (upper_is_odd && value % 2 == 1)) {
+            return value + 1;
+        }
+        return value;
+    }
+    if (value >= 0x391 && value <= 0x3AB && value != 0x3A2) {
+        return value + 0x20;
+    }
+    if (value >= 0x410 && value <= 0x42F) {
+        return value + 0x20;
+    }
+    if (value >= 0x400 && value <= 0x40F) {
+        return value + 0x50;
+    }
+    return value;
+}
+
+void AppendWithoutDiacritics(std::pmr::string& text, char32_t value) {
+    if (value >= 0x300 && value <= 0x36F) {
+        // Combining marks of decomposed text
+        return;
+    }
+    if (value == 0x401 || value == 0x451) {
+        // Ё and ё
+        return AppendCodePoint(text, value == 0x401 ? 0x415 : 0x435);
+    }
+    if (value < 0xC0 || value >= 0x180) {
+        return AppendCodePoint(text, value);
+    }
+    const char base = BASE_LETTERS[value - 0xC0];
+    if (base == '*') {
+        return AppendCodePoint(text, value);
+    }
+    if (base != '#') {
+        text.push_back(base);
+        return;
+    }
+    switch (value) {
+    case 0xC6: text += "AE"; break;
+    case 0xDE: text += "TH"; break;
+    case 0xDF: text += "ss"; break;
+    case 0xE6: text += "ae"; break;
+    case 0xFE: text += "th"; break;
+    case 0x132: text += "IJ"; break;
+    case 0x133: text += "ij"; break;
+    case 0x152: text += "OE"; break;
+    case 0x153: text += "oe"; break;
+    }
+}
+
+// Table-driven check for the common case of a word that normalization keeps
+bool IsNormalized(const std::string_view word, const NormalizationOptions& options, const std::string_view keep) {
+    for (size_t i = 0; i < word.size(); ++i) {
+        switch (GetByteClass(word[i])) {
+        case ByteClass::NON_ASCII:
+            return false;
+        case ByteClass::UPPER:
+            if (options.fold_case) {
+                return false;
+            }
+            break;
+        case ByteClass::PUNCTUATION:
+            if (options.strip_punctuation && (i == 0 || i + 1 == word.size()) && keep.find(word[i]) == keep.npos) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool IsPlainLowercaseText(const std::string_view text) {
+    size_t pos = 0;
+#if defined(__SSE2__)
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i before_0 = _mm_set1_epi8('0' - 1);
+    const __m128i after_9 = _mm_set1_epi8('9' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
+    // Bytes from 0x80 are negative as signed chars, so they fail both ranges
+    for (; pos + 16 <= text.size(); pos += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_a), _mm_cmplt_epi8(bytes, after_z));
+        const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_0), _mm_cmplt_epi8(bytes, after_9));
+        const __m128i plain = _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(bytes, space));
+        if (_mm_movemask_epi8(plain) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; pos < text.size(); ++pos) {
+        if (GetByteClass(text[pos]) != ByteClass::PLAIN && text[pos] != ' ') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view NormalizeWord(const std::string_view word, const NormalizationOptions& options, const std::string_view keep,
+                               std::pmr::memory_resource* resource) {
+    if (!options.fold_case && !options.strip_punctuation && !options.remove_diacritics) {
+        return word;
+    }
+    if (IsNormalized(word, options, keep)) {
+        return word;
+    }
+
+    std::pmr::vector<char32_t> code_points(resource);
+    code_points.reserve(word.size());
+    for (size_t pos = 0; pos < word.size();) {
+        code_points.push_back(DecodeCodePoint(word, pos));
+    }
+
+    auto first = code_points.begin();
+    auto last = code_points.end();
+    if (options.strip_punctuation) {
+        while (first != last && IsPunctuation(*first, keep)) {
+            ++first;
+        }
+        while (last != first && IsPunctuation(*(last - 1), keep)) {
+            --last;
+        }
+    }
+
+    std::pmr::string normalized(resource);
+    normalized.reserve(word.size());
+    for (auto it = first; it != last; ++it) {
+        const char32_t value = options.fold_case ? FoldCase(*it) : *it;
+        if (options.remove_diacritics) {
+            AppendWithoutDiacritics(normalized, value);
+        } else {
+            AppendCodePoint(normalized, value);
+        }
+    }
+
+    if (normalized == word) {
+        return word;
+    }
+    if (normalized.empty()) {
+        return {};
+    }
+    char* const data = static_cast<char*>(resource->allocate(normalized.size(), 1));
+    std::copy(normalized.begin(), normalized.end(), data);
+    return {data, normalized.size()};
+}
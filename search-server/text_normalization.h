@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory_resource>
+#include <string_view>
+
+// How words are normalized before they are indexed or looked up. Text is read
+// as UTF-8; bytes that do not form a valid sequence are kept as they are.
+struct NormalizationOptions {
+    // Lowercases ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic letters
+    bool fold_case = true;
+    // Drops punctuation at the start and the end of a word: "(cat)," is cat,
+    // e-mail and 3.14 stay as they are
+    bool strip_punctuation = true;
+    // Replaces accented Latin letters with their base letters (café is cafe,
+    // straße is strasse), ё with е and drops combining marks
+    bool remove_diacritics = false;
+};
+
+// Whether the text consists of lowercase ASCII letters, digits and spaces only,
+// so none of its words changes under any normalization
+bool IsPlainLowercaseText(const std::string_view text);
+
+// Returns the word itself if normalization does not change it, otherwise the
+// normalized word allocated from the resource. The characters in keep are not
+// stripped as punctuation. A word made of punctuation only becomes empty.
+std::string_view NormalizeWord(const std::string_view word, const NormalizationOptions& options, const std::string_view keep,
+                               std::pmr::memory_resource* resource);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// LEB128: 7 bits per byte, the high bit set on all bytes but the last.
+// Small numbers such as gaps between word positions take a single byte.
+
+template <typename ByteContainer>
+void AppendVarint(ByteContainer& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<unsigned char>(value));
+}
+
+inline uint32_t ReadVarint(const unsigned char*& data) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const unsigned char byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Stable 64-bit hashes of words, used for document fingerprints and MinHash
+
+// splitmix64 finalizer: spreads every input bit over the whole result
+inline uint64_t MixHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+// FNV-1a followed by MixHash
+inline uint64_t HashWord(std::string_view word) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return MixHash(hash);
+}